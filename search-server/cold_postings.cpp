@@ -0,0 +1,121 @@
+#include "cold_postings.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <system_error>
+#include <utility>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+[[noreturn]] void ThrowSystemError(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+}
+
+#ifdef __linux__
+
+ColdPostingFile::ColdPostingFile(std::string path) : path_(std::move(path)) {
+    fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd_ < 0) {
+        ThrowSystemError("Cannot open cold posting file");
+    }
+}
+
+ColdPostingFile::~ColdPostingFile() {
+    if (mapping_) {
+        munmap(mapping_, capacity_ * sizeof(Record));
+    }
+    close(fd_);
+    std::remove(path_.c_str());
+}
+
+ColdPostingFile::Location ColdPostingFile::Append(const std::vector<Record>& records) {
+    if (records.empty()) {
+        return {};
+    }
+    Reserve(record_count_ + records.size());
+    const size_t bytes = records.size() * sizeof(Record);
+    const char* data = reinterpret_cast<const char*>(records.data());
+    for (size_t written = 0; written < bytes;) {
+        const ssize_t result = pwrite(fd_, data + written, bytes - written, static_cast<off_t>(record_count_ * sizeof(Record) + written));
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("Cannot write cold posting file");
+        }
+        written += static_cast<size_t>(result);
+    }
+    const Location location{ record_count_, records.size() };
+    record_count_ += records.size();
+    return location;
+}
+
+void ColdPostingFile::Reserve(size_t record_count) {
+    if (record_count <= capacity_) {
+        return;
+    }
+    const size_t capacity = std::max(record_count, std::max<size_t>(1024, capacity_ * 2));
+    if (ftruncate(fd_, static_cast<off_t>(capacity * sizeof(Record))) != 0) {
+        ThrowSystemError("Cannot grow cold posting file");
+    }
+    void* mapping = mmap(nullptr, capacity * sizeof(Record), PROT_READ, MAP_SHARED, fd_, 0);
+    if (mapping == MAP_FAILED) {
+        ThrowSystemError("Cannot map cold posting file");
+    }
+    if (mapping_) {
+        munmap(mapping_, capacity_ * sizeof(Record));
+    }
+    mapping_ = mapping;
+    capacity_ = capacity;
+}
+
+#else
+
+ColdPostingFile::ColdPostingFile(std::string path) : path_(std::move(path)) {
+    throw std::system_error(std::make_error_code(std::errc::not_supported), "Cold posting files need mmap");
+}
+
+ColdPostingFile::~ColdPostingFile() = default;
+
+ColdPostingFile::Location ColdPostingFile::Append(const std::vector<Record>&) {
+    return {};
+}
+
+void ColdPostingFile::Reserve(size_t) {
+}
+
+#endif
+
+const ColdPostingFile::Record* ColdPostingFile::GetRecords(const Location& location) const {
+    return static_cast<const Record*>(mapping_) + location.offset;
+}
+
+void ColdPostingFile::MoveTo(std::string path) {
+    if (std::rename(path_.c_str(), path.c_str()) != 0) {
+        ThrowSystemError("Cannot rename cold posting file");
+    }
+    path_ = std::move(path);
+}
+
+void ColdPostingFile::Release(const Location& location) {
+    garbage_count_ += location.count;
+}
+
+const std::string& ColdPostingFile::GetPath() const {
+    return path_;
+}
+
+size_t ColdPostingFile::GetRecordCount() const {
+    return record_count_;
+}
+
+size_t ColdPostingFile::GetGarbageCount() const {
+    return garbage_count_;
+}
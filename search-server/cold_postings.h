@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Append-only file of posting lists demoted out of memory. The file is memory-mapped read-only,
+// so reading a list pages it in on demand and the kernel may drop it again under memory pressure.
+// The mmap backend is Linux only; elsewhere the constructor throws std::system_error, since
+// reading lists into memory instead would cost more than keeping them resident.
+// Lists are never rewritten in place: released ones are counted as garbage until the owner
+// copies the live lists into a new file. The file is deleted when the object is destroyed.
+class ColdPostingFile {
+public:
+    struct Record {
+        uint32_t ordinal;
+        double term_freq;
+    };
+
+    // Position of a list in the file, count is 0 for no list
+    struct Location {
+        size_t offset = 0;
+        size_t count = 0;
+    };
+
+    explicit ColdPostingFile(std::string path);
+    ColdPostingFile(const ColdPostingFile&) = delete;
+    ColdPostingFile& operator=(const ColdPostingFile&) = delete;
+    ~ColdPostingFile();
+
+    Location Append(const std::vector<Record>& records);
+    // Valid until the next Append, which may remap the file
+    const Record* GetRecords(const Location& location) const;
+    void Release(const Location& location);
+
+    // Renames the file, replacing any file at path
+    void MoveTo(std::string path);
+
+    const std::string& GetPath() const;
+    size_t GetRecordCount() const;
+    size_t GetGarbageCount() const;
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    void* mapping_ = nullptr;
+    // Records the file and the mapping have room for, grown geometrically to make remapping rare
+    size_t capacity_ = 0;
+    size_t record_count_ = 0;
+    size_t garbage_count_ = 0;
+
+    void Reserve(size_t record_count);
+};
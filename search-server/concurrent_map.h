@@ -1,65 +1,214 @@
+#pragma once
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
-#include <future>
-#include <map>
-#include <numeric>
-#include <random>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-template <typename Key, typename Value>
+// Test-and-test-and-set lock for the short critical sections of ConcurrentMap
+class SpinLock {
+public:
+    void lock() {
+        while (locked_.exchange(true, std::memory_order_acquire)) {
+            while (locked_.load(std::memory_order_relaxed)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void unlock() {
+        locked_.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> locked_{ false };
+};
+
+// Hash map split into independently locked buckets. Every bucket is an open addressing
+// table with linear probing and sits on its own cache line, so threads updating
+// different buckets do not false-share.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
 class ConcurrentMap {
 private:
+    enum class SlotState : uint8_t {
+        EMPTY,
+        FULL,
+        ERASED
+    };
 
-    struct Bucket {
-        std::mutex mutex;
-        std::map<Key, Value> map;
+    struct Slot {
+        Key key{};
+        Value value{};
+        SlotState state = SlotState::EMPTY;
     };
 
-public:
-    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys");
+    struct alignas(64) Bucket {
+        SpinLock lock;
+        std::vector<Slot> slots;
+        size_t size = 0;
+        // Full and erased slots, erased ones still lengthen probe sequences
+        size_t used = 0;
+    };
 
+public:
     struct Access {
-        std::lock_guard<std::mutex> lock;
+        std::lock_guard<SpinLock> lock;
         Value& ref_to_value;
 
-        Access(const Key& key, Bucket& bucket) : lock(bucket.mutex), ref_to_value(bucket.map[key]) {
+        Access(const Key& key, Bucket& bucket, size_t hash) : lock(bucket.lock), ref_to_value(FindOrInsert(bucket, key, hash)) {
 
         }
     };
 
-    explicit ConcurrentMap(size_t bucket_count) : buckets_(bucket_count) {
+    explicit ConcurrentMap(size_t bucket_count) : buckets_(std::max<size_t>(1, bucket_count)) {
 
     }
 
     Access operator[](const Key& key) {
-        Bucket& bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
-        return {key, bucket};
+        const size_t hash = Hash{}(key);
+        return { key, GetBucket(hash), hash };
     }
 
-    std::map<Key, Value> BuildOrdinaryMap() {
-        std::map<Key, Value> ordinary_map;
-        for (auto& [mutex, map] : buckets_) {
-            std::lock_guard<std::mutex> lock(mutex);
-            ordinary_map.insert(map.begin(), map.end());
-        }
-        return ordinary_map;
+    // value += delta under the bucket lock, without handing out a reference
+    template <typename Delta>
+    void Add(const Key& key, const Delta& delta) {
+        static_assert(std::is_arithmetic_v<Value>, "Add supports only arithmetic values");
+        const size_t hash = Hash{}(key);
+        Bucket& bucket = GetBucket(hash);
+        std::lock_guard<SpinLock> lock(bucket.lock);
+        FindOrInsert(bucket, key, hash) += delta;
     }
 
     void erase(const Key& key) {
-        Bucket& bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
-        std::lock_guard<std::mutex> lock(bucket.mutex);
-        bucket.map.erase(key);
+        const size_t hash = Hash{}(key);
+        Bucket& bucket = GetBucket(hash);
+        std::lock_guard<SpinLock> lock(bucket.lock);
+        if (bucket.slots.empty()) {
+            return;
+        }
+        const size_t mask = bucket.slots.size() - 1;
+        for (size_t index = GetSlotHash(hash) & mask;; index = (index + 1) & mask) {
+            Slot& slot = bucket.slots[index];
+            if (slot.state == SlotState::EMPTY) {
+                return;
+            }
+            if (slot.state == SlotState::FULL && slot.key == key) {
+                slot.state = SlotState::ERASED;
+                slot.value = Value{};
+                --bucket.size;
+                return;
+            }
+        }
+    }
+
+    // Calls function(key, value) for every element, locking one bucket at a time
+    template <typename Function>
+    void ForEach(Function function) {
+        for (Bucket& bucket : buckets_) {
+            std::lock_guard<SpinLock> lock(bucket.lock);
+            for (Slot& slot : bucket.slots) {
+                if (slot.state == SlotState::FULL) {
+                    function(slot.key, slot.value);
+                }
+            }
+        }
+    }
+
+    // Moves all elements out in no particular order and leaves the map empty
+    std::vector<std::pair<Key, Value>> Extract() {
+        std::vector<std::pair<Key, Value>> elements;
+        elements.reserve(size());
+        for (Bucket& bucket : buckets_) {
+            std::lock_guard<SpinLock> lock(bucket.lock);
+            for (Slot& slot : bucket.slots) {
+                if (slot.state == SlotState::FULL) {
+                    elements.emplace_back(std::move(slot.key), std::move(slot.value));
+                }
+            }
+            bucket.slots.clear();
+            bucket.size = 0;
+            bucket.used = 0;
+        }
+        return elements;
     }
 
     [[nodiscard]] size_t size() const {
         size_t size = 0;
         for (const Bucket& bucket : buckets_) {
-            size += bucket.map.size();
+            size += bucket.size;
         }
         return size;
     }
 
 private:
+    static constexpr size_t INITIAL_SLOT_COUNT = 16;
+
     std::vector<Bucket> buckets_;
-};
\ No newline at end of file
+
+    Bucket& GetBucket(size_t hash) {
+        return buckets_[hash % buckets_.size()];
+    }
+
+    // std::hash of integers is the identity, mixing keeps consecutive keys from clustering
+    static size_t GetSlotHash(size_t hash) {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    static Value& FindOrInsert(Bucket& bucket, const Key& key, size_t hash) {
+        // Keep at most 70% of the slots used so probe sequences stay short
+        if ((bucket.used + 1) * 10 > bucket.slots.size() * 7) {
+            Rehash(bucket);
+        }
+        const size_t mask = bucket.slots.size() - 1;
+        Slot* reusable = nullptr;
+        for (size_t index = GetSlotHash(hash) & mask;; index = (index + 1) & mask) {
+            Slot& slot = bucket.slots[index];
+            if (slot.state == SlotState::FULL && slot.key == key) {
+                return slot.value;
+            }
+            if (slot.state == SlotState::ERASED && !reusable) {
+                reusable = &slot;
+            }
+            if (slot.state == SlotState::EMPTY) {
+                if (!reusable) {
+                    reusable = &slot;
+                    ++bucket.used;
+                }
+                reusable->key = key;
+                reusable->state = SlotState::FULL;
+                ++bucket.size;
+                return reusable->value;
+            }
+        }
+    }
+
+    static void Rehash(Bucket& bucket) {
+        size_t slot_count = std::max(INITIAL_SLOT_COUNT, bucket.slots.size());
+        while ((bucket.size + 1) * 10 > slot_count * 5) {
+            slot_count *= 2;
+        }
+        std::vector<Slot> slots(slot_count);
+        const size_t mask = slot_count - 1;
+        for (Slot& slot : bucket.slots) {
+            if (slot.state != SlotState::FULL) {
+                continue;
+            }
+            size_t index = GetSlotHash(Hash{}(slot.key)) & mask;
+            while (slots[index].state == SlotState::FULL) {
+                index = (index + 1) & mask;
+            }
+            slots[index] = std::move(slot);
+        }
+        bucket.slots = std::move(slots);
+        bucket.used = bucket.size;
+    }
+};
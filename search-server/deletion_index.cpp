@@ -0,0 +1,121 @@
+#include "deletion_index.h"
+
+#include <algorithm>
+
+namespace {
+
+// Splits a UTF-8 string into characters so that deletions never cut a multibyte sequence
+std::vector<std::string_view> SplitIntoCharacters(const std::string_view word) {
+    std::vector<std::string_view> characters;
+    size_t begin = 0;
+    while (begin < word.size()) {
+        size_t end = begin + 1;
+        while (end < word.size() && (static_cast<unsigned char>(word[end]) & 0xC0) == 0x80) {
+            ++end;
+        }
+        characters.push_back(word.substr(begin, end - begin));
+        begin = end;
+    }
+    return characters;
+}
+
+}
+
+DeletionIndex::DeletionIndex(int max_edit_distance) : max_edit_distance_(max_edit_distance) {
+
+}
+
+void DeletionIndex::AddWord(const std::string_view word) {
+    for (const std::string& deletion : GenerateDeletions(word)) {
+        deletions_[deletion].insert(word);
+    }
+}
+
+void DeletionIndex::RemoveWord(const std::string_view word) {
+    for (const std::string& deletion : GenerateDeletions(word)) {
+        const auto it = deletions_.find(deletion);
+        if (it == deletions_.end()) {
+            continue;
+        }
+        it->second.erase(word);
+        if (it->second.empty()) {
+            deletions_.erase(it);
+        }
+    }
+}
+
+std::vector<DeletionIndex::Candidate> DeletionIndex::FindCandidates(const std::string_view word) const {
+    std::set<std::string_view> matched_words;
+    for (const std::string& deletion : GenerateDeletions(word)) {
+        const auto it = deletions_.find(deletion);
+        if (it != deletions_.end()) {
+            matched_words.insert(it->second.begin(), it->second.end());
+        }
+    }
+
+    // Shared deletions only bound the distance from above, so every candidate is verified
+    std::vector<Candidate> candidates;
+    for (const std::string_view matched_word : matched_words) {
+        const int distance = ComputeEditDistance(word, matched_word);
+        if (distance <= max_edit_distance_) {
+            candidates.push_back({ matched_word, distance });
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& lhs, const Candidate& rhs) {
+        return lhs.distance < rhs.distance;
+    });
+    return candidates;
+}
+
+int DeletionIndex::GetMaxEditDistance() const {
+    return max_edit_distance_;
+}
+
+std::set<std::string> DeletionIndex::GenerateDeletions(const std::string_view word) const {
+    std::set<std::string> deletions{ std::string(word) };
+    std::vector<std::vector<std::string_view>> current{ SplitIntoCharacters(word) };
+    for (int distance = 0; distance < max_edit_distance_; ++distance) {
+        std::vector<std::vector<std::string_view>> next;
+        for (const std::vector<std::string_view>& characters : current) {
+            for (size_t skip = 0; skip < characters.size(); ++skip) {
+                std::vector<std::string_view> deleted;
+                deleted.reserve(characters.size() - 1);
+                std::string deletion;
+                for (size_t i = 0; i < characters.size(); ++i) {
+                    if (i != skip) {
+                        deleted.push_back(characters[i]);
+                        deletion += characters[i];
+                    }
+                }
+                if (deletions.insert(std::move(deletion)).second) {
+                    next.push_back(std::move(deleted));
+                }
+            }
+        }
+        current = std::move(next);
+    }
+    return deletions;
+}
+
+int ComputeEditDistance(const std::string_view lhs, const std::string_view rhs) {
+    const std::vector<std::string_view> a = SplitIntoCharacters(lhs);
+    const std::vector<std::string_view> b = SplitIntoCharacters(rhs);
+
+    std::vector<std::vector<int>> distance(a.size() + 1, std::vector<int>(b.size() + 1));
+    for (size_t i = 0; i <= a.size(); ++i) {
+        distance[i][0] = static_cast<int>(i);
+    }
+    for (size_t j = 0; j <= b.size(); ++j) {
+        distance[0][j] = static_cast<int>(j);
+    }
+    for (size_t i = 1; i <= a.size(); ++i) {
+        for (size_t j = 1; j <= b.size(); ++j) {
+            const int cost = a[i - 1] == b[j - 1] ? 0 : 1;
+            distance[i][j] = std::min({ distance[i - 1][j] + 1, distance[i][j - 1] + 1, distance[i - 1][j - 1] + cost });
+            if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1]) {
+                distance[i][j] = std::min(distance[i][j], distance[i - 2][j - 2] + 1);
+            }
+        }
+    }
+    return distance[a.size()][b.size()];
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// SymSpell-style index: every vocabulary word is stored under all variants obtained
+// by deleting up to max_edit_distance characters, so typo candidates for a query word
+// are found by looking up the query word's own deletions instead of scanning the vocabulary.
+// Words are kept as string_view, the caller owns their storage.
+class DeletionIndex {
+public:
+    struct Candidate {
+        std::string_view word;
+        int distance;
+    };
+
+    explicit DeletionIndex(int max_edit_distance);
+
+    void AddWord(const std::string_view word);
+    void RemoveWord(const std::string_view word);
+
+    // Vocabulary words within max_edit_distance of word, closest first
+    std::vector<Candidate> FindCandidates(const std::string_view word) const;
+
+    int GetMaxEditDistance() const;
+
+private:
+    int max_edit_distance_;
+    std::map<std::string, std::set<std::string_view>, std::less<>> deletions_;
+
+    std::set<std::string> GenerateDeletions(const std::string_view word) const;
+};
+
+// Optimal string alignment distance counted in UTF-8 characters
+int ComputeEditDistance(const std::string_view lhs, const std::string_view rhs);
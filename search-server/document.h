@@ -1,5 +1,7 @@
 #pragma once
 #include <iostream>
+#include <string_view>
+#include <vector>
 
 enum class DocumentStatus {
     ACTUAL,
@@ -23,5 +25,20 @@ struct Document {
     }
 };
 
+// Documents found by a query that may be stopped early; is_partial is set when it was
+// and documents hold the best matches among the postings scored before that
+struct SearchResult {
+    std::vector<Document> documents;
+    bool is_partial = false;
+};
+
+// Input of SearchServer::AddDocuments, text must stay alive until the call returns
+struct DocumentToAdd {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
 void PrintDocument(const Document& document);
 std::ostream& operator<<(std::ostream& os, const Document& document);
\ No newline at end of file
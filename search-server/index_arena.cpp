@@ -0,0 +1,36 @@
+#include "index_arena.h"
+
+IndexArena::IndexArena() : reserved_(std::pmr::new_delete_resource()), pool_(&reserved_), used_(&pool_) {
+
+}
+
+std::pmr::memory_resource* IndexArena::GetResource() {
+    return &used_;
+}
+
+IndexArena::Stats IndexArena::GetStats() const {
+    return { reserved_.GetBytes(), used_.GetBytes() };
+}
+
+IndexArena::CountingResource::CountingResource(std::pmr::memory_resource* upstream) : upstream_(upstream) {
+
+}
+
+size_t IndexArena::CountingResource::GetBytes() const {
+    return bytes_.load(std::memory_order_relaxed);
+}
+
+void* IndexArena::CountingResource::do_allocate(size_t bytes, size_t alignment) {
+    void* pointer = upstream_->allocate(bytes, alignment);
+    bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    return pointer;
+}
+
+void IndexArena::CountingResource::do_deallocate(void* pointer, size_t bytes, size_t alignment) {
+    upstream_->deallocate(pointer, bytes, alignment);
+    bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+bool IndexArena::CountingResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
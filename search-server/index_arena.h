@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+
+// Memory resource of the index structures of a SearchServer. Small blocks come from pools
+// refilled in large chunks. The containers still free their nodes one by one into the pools
+// when they are destroyed; only returning the chunks to the heap happens at once, when the
+// arena is destroyed after them.
+class IndexArena {
+public:
+    struct Stats {
+        // Bytes obtained from the global heap
+        size_t bytes_reserved = 0;
+        // Bytes currently allocated by the index
+        size_t bytes_used = 0;
+    };
+
+    IndexArena();
+    IndexArena(const IndexArena&) = delete;
+    IndexArena& operator=(const IndexArena&) = delete;
+
+    std::pmr::memory_resource* GetResource();
+    Stats GetStats() const;
+
+private:
+    // Passes allocations through to upstream and counts the bytes outstanding
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        explicit CountingResource(std::pmr::memory_resource* upstream);
+
+        size_t GetBytes() const;
+
+    private:
+        std::pmr::memory_resource* upstream_;
+        std::atomic<size_t> bytes_{ 0 };
+
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    };
+
+    CountingResource reserved_;
+    // Synchronized because AddDocuments and Compact fill and clean postings from several threads
+    std::pmr::synchronized_pool_resource pool_;
+    CountingResource used_;
+};
@@ -0,0 +1,125 @@
+#include "posting_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+namespace {
+
+size_t SketchIndex(size_t hash, size_t row, size_t width) {
+    // Cheap independent-enough row hashes derived from one std::hash value
+    return (hash + row * ((hash >> 17) | 1)) % width;
+}
+
+}
+
+PostingCache::PostingCache(size_t capacity, size_t shard_count)
+    : shard_capacity_(std::max<size_t>(1, capacity / std::max<size_t>(1, shard_count))),
+      shards_(std::max<size_t>(1, shard_count)) {
+    if (capacity == 0) {
+        throw std::invalid_argument("Cache capacity must be positive");
+    }
+}
+
+std::shared_ptr<const PostingCache::PostingList> PostingCache::Get(const std::string& key, uint64_t generation) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    RecordAccess(shard, key);
+
+    const auto position = shard.positions.find(key);
+    if (position == shard.positions.end()) {
+        ++shard.stats.misses;
+        return nullptr;
+    }
+    if (position->second->generation != generation) {
+        Erase(shard, position->second);
+        ++shard.stats.misses;
+        return nullptr;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, position->second);
+    ++shard.stats.hits;
+    return shard.entries.front().posting_list;
+}
+
+void PostingCache::Put(const std::string& key, uint64_t generation, std::shared_ptr<const PostingList> posting_list) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const size_t size = posting_list->postings.size();
+    if (shard.positions.count(key) || size > shard_capacity_) {
+        ++shard.stats.rejections;
+        return;
+    }
+
+    // Evict from the cold end only if every live victim is requested less often than the candidate
+    const uint8_t frequency = EstimateFrequency(shard, key);
+    std::vector<std::list<Entry>::iterator> victims;
+    size_t freed = 0;
+    for (auto victim = shard.entries.end(); shard.cached_postings - freed + size > shard_capacity_;) {
+        --victim;
+        if (victim->generation == generation && EstimateFrequency(shard, victim->key) >= frequency) {
+            ++shard.stats.rejections;
+            return;
+        }
+        victims.push_back(victim);
+        freed += victim->posting_list->postings.size();
+    }
+    for (const auto victim : victims) {
+        Erase(shard, victim);
+    }
+
+    shard.entries.push_front(Entry{ key, generation, std::move(posting_list) });
+    shard.positions.emplace(shard.entries.front().key, shard.entries.begin());
+    shard.cached_postings += size;
+    ++shard.stats.admissions;
+}
+
+PostingCache::Stats PostingCache::GetStats() const {
+    Stats stats;
+    for (const Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.hits += shard.stats.hits;
+        stats.misses += shard.stats.misses;
+        stats.admissions += shard.stats.admissions;
+        stats.rejections += shard.stats.rejections;
+        stats.cached_postings += shard.cached_postings;
+    }
+    return stats;
+}
+
+PostingCache::Shard& PostingCache::GetShard(const std::string& key) {
+    return shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
+
+void PostingCache::RecordAccess(Shard& shard, const std::string& key) {
+    const size_t hash = std::hash<std::string>{}(key);
+    for (size_t row = 0; row < SKETCH_DEPTH; ++row) {
+        uint8_t& counter = shard.sketch[row][SketchIndex(hash, row, SKETCH_WIDTH)];
+        if (counter < UINT8_MAX) {
+            ++counter;
+        }
+    }
+    // Halving keeps the sketch biased towards recent popularity
+    if (++shard.sketch_increments >= SKETCH_WIDTH * 8) {
+        for (auto& row : shard.sketch) {
+            for (uint8_t& counter : row) {
+                counter /= 2;
+            }
+        }
+        shard.sketch_increments = 0;
+    }
+}
+
+uint8_t PostingCache::EstimateFrequency(const Shard& shard, const std::string& key) {
+    const size_t hash = std::hash<std::string>{}(key);
+    uint8_t frequency = UINT8_MAX;
+    for (size_t row = 0; row < SKETCH_DEPTH; ++row) {
+        frequency = std::min(frequency, shard.sketch[row][SketchIndex(hash, row, SKETCH_WIDTH)]);
+    }
+    return frequency;
+}
+
+void PostingCache::Erase(Shard& shard, std::list<Entry>::iterator entry) {
+    shard.cached_postings -= entry->posting_list->postings.size();
+    shard.positions.erase(entry->key);
+    shard.entries.erase(entry);
+}
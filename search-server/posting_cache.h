@@ -0,0 +1,79 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Bounded cache of filter-applied posting lists of hot terms. Admission is frequency
+// based: a candidate only displaces entries it has been requested more often than,
+// according to a small count-min sketch that is periodically halved.
+class PostingCache {
+public:
+    struct Posting {
+        uint32_t ordinal;
+        double term_freq;
+        int document_length;
+    };
+
+    struct PostingList {
+        // Live document frequency of the term before filtering, needed for idf
+        size_t document_freq = 0;
+        std::vector<Posting> postings;
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t admissions = 0;
+        uint64_t rejections = 0;
+        size_t cached_postings = 0;
+
+        double GetHitRate() const {
+            return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+        }
+    };
+
+    // capacity is the total number of postings kept across all shards
+    PostingCache(size_t capacity, size_t shard_count);
+
+    std::shared_ptr<const PostingList> Get(const std::string& key, uint64_t generation);
+    void Put(const std::string& key, uint64_t generation, std::shared_ptr<const PostingList> posting_list);
+
+    Stats GetStats() const;
+
+private:
+    static constexpr size_t SKETCH_DEPTH = 4;
+    static constexpr size_t SKETCH_WIDTH = 1024;
+
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        std::shared_ptr<const PostingList> posting_list;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        // Most recently used entries first
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> positions;
+        size_t cached_postings = 0;
+
+        std::array<std::array<uint8_t, SKETCH_WIDTH>, SKETCH_DEPTH> sketch{};
+        size_t sketch_increments = 0;
+
+        Stats stats;
+    };
+
+    size_t shard_capacity_;
+    std::vector<Shard> shards_;
+
+    Shard& GetShard(const std::string& key);
+    static void RecordAccess(Shard& shard, const std::string& key);
+    static uint8_t EstimateFrequency(const Shard& shard, const std::string& key);
+    static void Erase(Shard& shard, std::list<Entry>::iterator entry);
+};
@@ -1,7 +1,8 @@
 #pragma once
 #include <algorithm>
 #include <execution>
-#include <list>
+#include <future>
+#include <string_view>
 #include <vector>
 #include "document.h"
 #include "search_server.h"
@@ -10,6 +11,61 @@ std::vector<std::vector<Document>> ProcessQueries(
         const SearchServer& search_server,
         const std::vector<std::string>& queries);
 
-std::list<Document> ProcessQueriesJoined(
+std::vector<Document> ProcessQueriesJoined(
         const SearchServer& search_server,
-        const std::vector<std::string>& queries);
\ No newline at end of file
+        const std::vector<std::string>& queries);
+
+// Passes the documents found for every query to sink in query order without materialising
+// the whole batch: queries are ranked in windows of window_size, and the next window is
+// computed (on the server's thread pool if it has one) while the documents of the current
+// one are being consumed
+template<typename Sink>
+void ProcessQueriesJoined(
+        const SearchServer& search_server,
+        const std::vector<std::string>& queries,
+        Sink sink,
+        size_t window_size = 256);
+
+
+//Def
+template<typename Sink>
+void ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries, Sink sink, size_t window_size) {
+    window_size = std::max<size_t>(1, window_size);
+    const auto process_window = [&search_server, &queries, window_size](size_t window_begin) {
+        const size_t window_end = std::min(queries.size(), window_begin + window_size);
+        return search_server.FindTopDocumentsBatch(std::vector<std::string_view>(queries.begin() + window_begin, queries.begin() + window_end));
+    };
+
+    const std::shared_ptr<ThreadPool>& thread_pool = search_server.GetThreadPool();
+    const auto start_window = [&thread_pool, &process_window](size_t window_begin) {
+        if (thread_pool) {
+            return thread_pool->Submit([&process_window, window_begin]() { return process_window(window_begin); });
+        }
+        return std::async(std::launch::async, process_window, window_begin);
+    };
+
+    if (queries.empty()) {
+        return;
+    }
+    std::future<std::vector<std::vector<Document>>> window = start_window(0);
+    try {
+        for (size_t window_begin = 0; window_begin < queries.size(); window_begin += window_size) {
+            std::vector<std::vector<Document>> processed_queries = thread_pool ? thread_pool->Wait(window) : window.get();
+            if (window_begin + window_size < queries.size()) {
+                window = start_window(window_begin + window_size);
+            }
+            for (std::vector<Document>& documents : processed_queries) {
+                for (Document& document : documents) {
+                    sink(std::move(document));
+                }
+            }
+        }
+    }
+    catch (...) {
+        // The window in flight refers to this frame
+        if (window.valid()) {
+            window.wait();
+        }
+        throw;
+    }
+}
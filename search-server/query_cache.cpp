@@ -0,0 +1,73 @@
+#include "query_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+QueryResultCache::QueryResultCache(size_t capacity, size_t shard_count)
+    : shard_capacity_(std::max<size_t>(1, capacity / std::max<size_t>(1, shard_count))),
+      shards_(std::max<size_t>(1, shard_count)) {
+    if (capacity == 0) {
+        throw std::invalid_argument("Cache capacity must be positive");
+    }
+}
+
+std::optional<std::vector<Document>> QueryResultCache::Get(const std::string& key, uint64_t generation) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto position = shard.positions.find(key);
+    if (position == shard.positions.end()) {
+        ++shard.misses;
+        return std::nullopt;
+    }
+    if (position->second->generation != generation) {
+        shard.entries.erase(position->second);
+        shard.positions.erase(position);
+        ++shard.misses;
+        return std::nullopt;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, position->second);
+    ++shard.hits;
+    return shard.entries.front().documents;
+}
+
+void QueryResultCache::Put(const std::string& key, uint64_t generation, const std::vector<Document>& documents) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto position = shard.positions.find(key);
+    if (position != shard.positions.end()) {
+        position->second->generation = generation;
+        position->second->documents = documents;
+        shard.entries.splice(shard.entries.begin(), shard.entries, position->second);
+        return;
+    }
+    if (shard.entries.size() >= shard_capacity_) {
+        shard.positions.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+    shard.entries.push_front(Entry{ key, generation, documents });
+    shard.positions.emplace(shard.entries.front().key, shard.entries.begin());
+}
+
+void QueryResultCache::Clear() {
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.positions.clear();
+        shard.entries.clear();
+    }
+}
+
+QueryResultCache::Stats QueryResultCache::GetStats() const {
+    Stats stats;
+    for (const Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.size += shard.entries.size();
+    }
+    return stats;
+}
+
+QueryResultCache::Shard& QueryResultCache::GetShard(const std::string& key) {
+    return shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+
+// Sharded LRU cache of FindTopDocuments results keyed by the normalised query.
+// Every entry remembers the index generation it was computed for and is treated
+// as a miss once the server has been modified since.
+class QueryResultCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t size = 0;
+    };
+
+    QueryResultCache(size_t capacity, size_t shard_count);
+
+    std::optional<std::vector<Document>> Get(const std::string& key, uint64_t generation);
+    void Put(const std::string& key, uint64_t generation, const std::vector<Document>& documents);
+    void Clear();
+
+    Stats GetStats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        std::vector<Document> documents;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        // Most recently used entries first
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> positions;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    size_t shard_capacity_;
+    std::vector<Shard> shards_;
+
+    Shard& GetShard(const std::string& key);
+};
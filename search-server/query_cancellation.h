@@ -0,0 +1,35 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <optional>
+
+// Stops a query early, either explicitly through Cancel() or once a deadline passes.
+// One object may be shared by any number of threads.
+class QueryCancellation {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    QueryCancellation() = default;
+
+    explicit QueryCancellation(Clock::duration timeout)
+        : deadline_(Clock::now() + timeout) {
+
+    }
+
+    explicit QueryCancellation(Clock::time_point deadline)
+        : deadline_(deadline) {
+
+    }
+
+    void Cancel() {
+        cancelled_.store(true, std::memory_order_relaxed);
+    }
+
+    bool IsCancelled() const {
+        return cancelled_.load(std::memory_order_relaxed) || (deadline_ && Clock::now() >= *deadline_);
+    }
+
+private:
+    std::optional<Clock::time_point> deadline_;
+    std::atomic<bool> cancelled_{ false };
+};
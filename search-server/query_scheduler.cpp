@@ -0,0 +1,108 @@
+#include "query_scheduler.h"
+
+QueryScheduler::QueryScheduler(const SearchServer& search_server, std::shared_ptr<ThreadPool> thread_pool)
+    : search_server_(search_server), thread_pool_(std::move(thread_pool)) {
+    if (!thread_pool_) {
+        throw std::invalid_argument("No thread pool");
+    }
+}
+
+QueryScheduler::~QueryScheduler() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (PriorityClass& priority_class : classes_) {
+        for (PendingQuery& query : priority_class.queue) {
+            query.result.set_exception(std::make_exception_ptr(QueryRejected("Scheduler destroyed")));
+        }
+        priority_class.queue.clear();
+    }
+    all_finished_.wait(lock, [this]() {
+        return std::all_of(classes_.begin(), classes_.end(), [](const PriorityClass& priority_class) {
+            return priority_class.running == 0;
+        });
+    });
+}
+
+void QueryScheduler::SetLimits(QueryPriority priority, ClassLimits limits) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    classes_[static_cast<size_t>(priority)].limits = limits;
+    Dispatch();
+}
+
+std::future<std::vector<Document>> QueryScheduler::Submit(QueryPriority priority, std::string raw_query, DocumentStatus status) {
+    // Estimated outside the lock, it parses the query and reads only the index
+    const size_t cost = search_server_.EstimateQueryCost(raw_query);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    PriorityClass& priority_class = classes_[static_cast<size_t>(priority)];
+    if (cost > priority_class.limits.max_query_cost) {
+        ++priority_class.stats.throttled;
+        throw QueryRejected("Query is too expensive");
+    }
+    if (priority_class.queue.size() >= priority_class.limits.max_queued) {
+        ++priority_class.stats.shed;
+        throw QueryRejected("Query queue is full");
+    }
+    priority_class.queue.push_back(PendingQuery{ std::move(raw_query), status, {} });
+    std::future<std::vector<Document>> result = priority_class.queue.back().result.get_future();
+    Dispatch();
+    return result;
+}
+
+QueryScheduler::Stats QueryScheduler::GetStats(QueryPriority priority) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return classes_[static_cast<size_t>(priority)].stats;
+}
+
+void QueryScheduler::Dispatch() {
+    // Queries beyond the worker count would wait in the pool, where priorities no longer apply
+    size_t running = 0;
+    for (const PriorityClass& priority_class : classes_) {
+        running += priority_class.running;
+    }
+    for (size_t class_index = 0; class_index < classes_.size(); ++class_index) {
+        PriorityClass& priority_class = classes_[class_index];
+        while (!priority_class.queue.empty() && priority_class.running < priority_class.limits.max_running
+            && running < thread_pool_->GetWorkerCount()) {
+            ++priority_class.running;
+            ++running;
+            auto query = std::make_shared<PendingQuery>(std::move(priority_class.queue.front()));
+            priority_class.queue.pop_front();
+            thread_pool_->Submit([this, class_index, query]() {
+                Run(class_index, std::move(*query));
+            });
+        }
+        if (!priority_class.queue.empty()) {
+            return;
+        }
+    }
+}
+
+void QueryScheduler::Run(size_t class_index, PendingQuery query) {
+    std::vector<Document> documents;
+    std::exception_ptr error;
+    try {
+        documents = search_server_.FindTopDocuments(std::execution::seq, query.raw_query, query.status);
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        PriorityClass& priority_class = classes_[class_index];
+        --priority_class.running;
+        if (error) {
+            ++priority_class.stats.failed;
+        } else {
+            ++priority_class.stats.completed;
+        }
+        Dispatch();
+        all_finished_.notify_all();
+    }
+    // Published after the stats, so a caller holding the result also sees it counted
+    if (error) {
+        query.result.set_exception(error);
+    } else {
+        query.result.set_value(std::move(documents));
+    }
+}
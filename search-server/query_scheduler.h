@@ -0,0 +1,88 @@
+#pragma once
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+#include "thread_pool.h"
+
+// Classes in decreasing priority order
+enum class QueryPriority {
+    INTERACTIVE,
+    BULK
+};
+
+class QueryRejected : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Admission control in front of a SearchServer. Queries are queued per priority class and
+// dispatched to the thread pool, higher classes first, without exceeding each class'
+// concurrency limit or the number of pool workers. A lower class is held back while a higher
+// one has queued queries, so it never takes a worker a higher class query is waiting for.
+// A query is rejected with QueryRejected before it starts when its class queue is full or
+// its estimated cost (postings to traverse) exceeds the class limit.
+class QueryScheduler {
+public:
+    struct ClassLimits {
+        size_t max_running = 4;
+        size_t max_queued = 1024;
+        size_t max_query_cost = std::numeric_limits<size_t>::max();
+    };
+
+    struct Stats {
+        uint64_t completed = 0;
+        // Queries that started and threw, not counted as completed
+        uint64_t failed = 0;
+        uint64_t shed = 0;
+        uint64_t throttled = 0;
+    };
+
+    QueryScheduler(const SearchServer& search_server, std::shared_ptr<ThreadPool> thread_pool);
+    ~QueryScheduler();
+
+    QueryScheduler(const QueryScheduler&) = delete;
+    QueryScheduler& operator=(const QueryScheduler&) = delete;
+
+    void SetLimits(QueryPriority priority, ClassLimits limits);
+
+    std::future<std::vector<Document>> Submit(QueryPriority priority, std::string raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+
+    Stats GetStats(QueryPriority priority) const;
+
+private:
+    static constexpr size_t PRIORITY_COUNT = 2;
+
+    struct PendingQuery {
+        std::string raw_query;
+        DocumentStatus status;
+        std::promise<std::vector<Document>> result;
+    };
+
+    struct PriorityClass {
+        ClassLimits limits;
+        std::deque<PendingQuery> queue;
+        size_t running = 0;
+        Stats stats;
+    };
+
+    const SearchServer& search_server_;
+    std::shared_ptr<ThreadPool> thread_pool_;
+    mutable std::mutex mutex_;
+    std::condition_variable all_finished_;
+    std::array<PriorityClass, PRIORITY_COUNT> classes_;
+
+    // Starts queued queries in priority order while there are free slots, called with mutex_ held
+    void Dispatch();
+    void Run(size_t class_index, PendingQuery query);
+};
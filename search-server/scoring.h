@@ -0,0 +1,63 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+
+// Corpus-wide values a scorer needs, captured once per query
+struct CorpusStatistics {
+    size_t document_count = 0;
+    double average_document_length = 0.0;
+};
+
+// A scorer is chosen at compile time through the Scorer template parameter of
+// SearchServer::FindTopDocuments. It is built once per query and must provide
+//     double ComputeInverseDocumentFreq(size_t documents_with_word) const;
+//     double ComputeTermScore(double term_freq, double idf, int document_length) const;
+// where term_freq is the share of the document's words equal to the term.
+
+class TfIdfScorer {
+public:
+    explicit TfIdfScorer(const CorpusStatistics& statistics)
+        : document_count_(static_cast<double>(statistics.document_count)) {
+
+    }
+
+    double ComputeInverseDocumentFreq(size_t documents_with_word) const {
+        return std::log(document_count_ / documents_with_word);
+    }
+
+    double ComputeTermScore(double term_freq, double idf, int /*document_length*/) const {
+        return term_freq * idf;
+    }
+
+private:
+    double document_count_;
+};
+
+class Bm25Scorer {
+public:
+    static constexpr double K1 = 1.2;
+    static constexpr double B = 0.75;
+
+    explicit Bm25Scorer(const CorpusStatistics& statistics)
+        : document_count_(static_cast<double>(statistics.document_count)),
+          // k1 * (1 - b + b * length / average_length) == norm_base_ + norm_per_word_ * length
+          norm_base_(K1 * (1.0 - B)),
+          norm_per_word_(statistics.average_document_length > 0.0 ? K1 * B / statistics.average_document_length : 0.0) {
+
+    }
+
+    double ComputeInverseDocumentFreq(size_t documents_with_word) const {
+        const double documents = static_cast<double>(documents_with_word);
+        return std::log((document_count_ - documents + 0.5) / (documents + 0.5) + 1.0);
+    }
+
+    double ComputeTermScore(double term_freq, double idf, int document_length) const {
+        const double term_count = term_freq * document_length;
+        return idf * term_count * (K1 + 1.0) / (term_count + norm_base_ + norm_per_word_ * document_length);
+    }
+
+private:
+    double document_count_;
+    double norm_base_;
+    double norm_per_word_;
+};
@@ -3,41 +3,1014 @@
 void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
     using namespace std::literals::string_literals;
     if (document_id < 0) throw std::invalid_argument("Negative ID"s);
-    if (documents_info_.count(document_id)) throw std::invalid_argument("This ID already exists"s);
+    if (ordinals_.count(document_id)) throw std::invalid_argument("This ID already exists"s);
+    if (IsMemoryBudgetExceeded()) throw MemoryBudgetExceeded("Memory budget exceeded"s);
 
-    const std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
-    const double tf_one_word = 1.0 / words.size();
-    std::map<std::string, double> freqs_of_words;
+    const ParsedDocument parsed_document = ParseDocument(document, status, ratings);
+    ++index_generation_;
+    const uint32_t ordinal = AllocateOrdinal(document_id);
+    std::vector<TermEntry> term_entries;
+    term_entries.reserve(parsed_document.word_counts.size());
+    for (const auto& [word, count] : parsed_document.word_counts) {
+        const uint32_t term_id = InsertTerm(word);
+        Postings& postings = GetResidentPostings(term_id);
+        postings.emplace(ordinal, ComputeTermFreq(count, parsed_document.word_count));
+        AddLiveDocumentFreq(term_id, 1);
+        term_entries.push_back({ term_id, count });
+    }
+    total_word_count_ += parsed_document.word_count;
+    ++status_counts_[status];
+    documents_[ordinal] = StoreDocumentInfo(parsed_document, std::move(term_entries));
+    document_ids_.insert(document_id);
+}
 
-    std::vector<std::string> document_words(words.begin(), words.end());
-    document_words.erase(std::unique(document_words.begin(), document_words.end()), document_words.end());
-    std::sort(document_words.begin(), document_words.end());
+std::vector<std::exception_ptr> SearchServer::AddDocuments(const std::vector<DocumentToAdd>& documents) {
+    using namespace std::literals::string_literals;
+    std::vector<std::exception_ptr> errors(documents.size());
+
+    // Ids are checked up front, an id repeated within the batch fails every occurrence after the first
+    std::vector<size_t> accepted;
+    accepted.reserve(documents.size());
+    std::unordered_set<int> batch_ids;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const int document_id = documents[i].id;
+        if (document_id < 0) {
+            errors[i] = std::make_exception_ptr(std::invalid_argument("Negative ID"s));
+        } else if (ordinals_.count(document_id) || !batch_ids.insert(document_id).second) {
+            errors[i] = std::make_exception_ptr(std::invalid_argument("This ID already exists"s));
+        } else {
+            accepted.push_back(i);
+        }
+    }
+    if (!accepted.empty() && IsMemoryBudgetExceeded()) {
+        for (const size_t i : accepted) {
+            errors[i] = std::make_exception_ptr(MemoryBudgetExceeded("Memory budget exceeded"s));
+        }
+        accepted.clear();
+    }
+    if (accepted.empty()) {
+        return errors;
+    }
 
+    const size_t chunk_count = std::min(accepted.size(), GetParallelWorkerCount());
+    std::vector<size_t> chunks(chunk_count);
+    std::iota(chunks.begin(), chunks.end(), 0);
+    const auto for_each_in_chunk = [&](size_t chunk, const auto& function) {
+        const size_t first = accepted.size() * chunk / chunk_count;
+        const size_t last = accepted.size() * (chunk + 1) / chunk_count;
+        for (size_t position = first; position < last; ++position) {
+            function(accepted[position]);
+        }
+    };
+    std::vector<std::optional<ParsedDocument>> parsed_documents(documents.size());
+    ForEachParallel(chunks.begin(), chunks.end(), [&](size_t chunk) {
+        for_each_in_chunk(chunk, [&](size_t i) {
+            try {
+                parsed_documents[i] = ParseDocument(documents[i].text, documents[i].status, documents[i].ratings);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    });
+
+    // Ordinals go to the documents that parsed, in batch order
+    std::vector<uint32_t> ordinals(documents.size());
+    for (const size_t i : accepted) {
+        if (parsed_documents[i]) {
+            ordinals[i] = AllocateOrdinal(documents[i].id);
+        }
+    }
+
+    // Every chunk of documents is indexed by one worker into its own partial inverted index
+    using ChunkPostings = std::vector<std::pair<uint32_t, double>>;
+    std::vector<std::map<std::string_view, ChunkPostings>> chunk_indexes(chunk_count);
+    ForEachParallel(chunks.begin(), chunks.end(), [&](size_t chunk) {
+        for_each_in_chunk(chunk, [&](size_t i) {
+            if (!parsed_documents[i]) {
+                return;
+            }
+            for (const auto& [word, count] : parsed_documents[i]->word_counts) {
+                chunk_indexes[chunk][word].emplace_back(ordinals[i], ComputeTermFreq(count, parsed_documents[i]->word_count));
+            }
+        });
+    });
+
+    // One ordered pass over the batch vocabulary finds or creates every term in index_,
+    // then each term's postings are merged by a single worker
+    std::map<std::string_view, std::vector<const ChunkPostings*>> batch_terms;
+    for (const auto& chunk_index : chunk_indexes) {
+        for (const auto& [word, postings] : chunk_index) {
+            batch_terms[word].push_back(&postings);
+        }
+    }
+    std::vector<std::pair<Postings*, const std::vector<const ChunkPostings*>*>> merges;
+    merges.reserve(batch_terms.size());
+    for (const auto& [word, chunk_postings] : batch_terms) {
+        merges.emplace_back(&GetResidentPostings(InsertTerm(word)), &chunk_postings);
+    }
+    ForEachParallel(merges.begin(), merges.end(), [](const auto& merge) {
+        for (const ChunkPostings* postings : *merge.second) {
+            for (const auto& [ordinal, term_freq] : *postings) {
+                merge.first->emplace_hint(merge.first->end(), ordinal, term_freq);
+            }
+        }
+    });
+
+    // The vocabulary is complete now, forward index entries are built by the same chunks
+    std::vector<std::vector<TermEntry>> term_entries(documents.size());
+    ForEachParallel(chunks.begin(), chunks.end(), [&](size_t chunk) {
+        for_each_in_chunk(chunk, [&](size_t i) {
+            if (!parsed_documents[i]) {
+                return;
+            }
+            term_entries[i].reserve(parsed_documents[i]->word_counts.size());
+            for (const auto& [word, count] : parsed_documents[i]->word_counts) {
+                term_entries[i].push_back({ term_ids_.find(word)->second, count });
+            }
+        });
+    });
+
+    ++index_generation_;
+    for (const size_t i : accepted) {
+        if (!parsed_documents[i]) {
+            continue;
+        }
+        for (const TermEntry& entry : term_entries[i]) {
+            AddLiveDocumentFreq(entry.term_id, 1);
+        }
+        total_word_count_ += parsed_documents[i]->word_count;
+        ++status_counts_[parsed_documents[i]->status];
+        documents_[ordinals[i]] = StoreDocumentInfo(*parsed_documents[i], std::move(term_entries[i]));
+        document_ids_.insert(documents[i].id);
+    }
+    return errors;
+}
+
+void SearchServer::UpdateDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+    const uint32_t ordinal = GetOrdinal(document_id);
+    DocumentInfo& document_info = documents_[ordinal];
+    const ParsedDocument parsed_document = ParseDocument(document, status, ratings);
+    ++index_generation_;
+
+    std::vector<TermEntry> term_entries;
+    term_entries.reserve(parsed_document.word_counts.size());
+    for (const auto& [word, count] : parsed_document.word_counts) {
+        term_entries.push_back({ InsertTerm(word), count });
+    }
+    std::sort(term_entries.begin(), term_entries.end(), [](const TermEntry& lhs, const TermEntry& rhs) {
+        return lhs.term_id < rhs.term_id;
+    });
+
+    // Both entry ranges are sorted by term id, one merge pass finds removed, added and changed terms
+    const auto [old_first, old_last] = GetTermEntries(document_info);
+    auto old_entry = old_first;
+    auto new_entry = term_entries.cbegin();
+    while (old_entry != old_last || new_entry != term_entries.cend()) {
+        if (new_entry == term_entries.cend() || (old_entry != old_last && old_entry->term_id < new_entry->term_id)) {
+            Postings& postings = GetResidentPostings(old_entry->term_id);
+            postings.erase(ordinal);
+            AddLiveDocumentFreq(old_entry->term_id, -1);
+            if (postings.empty()) {
+                EraseTerm(old_entry->term_id);
+            }
+            ++old_entry;
+        } else if (old_entry == old_last || new_entry->term_id < old_entry->term_id) {
+            Postings& postings = GetResidentPostings(new_entry->term_id);
+            postings.emplace(ordinal, ComputeTermFreq(new_entry->count, parsed_document.word_count));
+            AddLiveDocumentFreq(new_entry->term_id, 1);
+            ++new_entry;
+        } else {
+            const double old_term_freq = ComputeTermFreq(old_entry->count, document_info.word_count);
+            const double new_term_freq = ComputeTermFreq(new_entry->count, parsed_document.word_count);
+            if (old_term_freq != new_term_freq) {
+                GetResidentPostings(new_entry->term_id)[ordinal] = new_term_freq;
+            }
+            ++old_entry;
+            ++new_entry;
+        }
+    }
+
+    total_word_count_ += parsed_document.word_count - document_info.word_count;
+    CountStatus(document_info.status, status);
+    forward_index_garbage_ += document_info.term_count;
+    document_info = StoreDocumentInfo(parsed_document, std::move(term_entries));
+    CompactForwardIndexIfNeeded();
+}
+
+void SearchServer::UpdateDocumentStatus(int document_id, DocumentStatus status) {
+    DocumentInfo& document_info = documents_[GetOrdinal(document_id)];
+    CountStatus(document_info.status, status);
+    document_info.status = status;
+    ++index_generation_;
+}
+
+void SearchServer::UpdateDocumentRating(int document_id, const std::vector<int>& ratings) {
+    documents_[GetOrdinal(document_id)].rating = ComputeAverageRating(ratings);
+    ++index_generation_;
+}
+
+uint32_t SearchServer::GetOrdinal(int document_id) const {
+    using namespace std::literals::string_literals;
+    const auto ordinal = ordinals_.find(document_id);
+    if (ordinal == ordinals_.end()) {
+        throw std::out_of_range("No such ID"s);
+    }
+    return ordinal->second;
+}
+
+uint32_t SearchServer::AllocateOrdinal(int document_id) {
+    uint32_t ordinal = static_cast<uint32_t>(documents_.size());
+    if (free_ordinals_.empty()) {
+        external_ids_.push_back(document_id);
+        documents_.emplace_back();
+        removed_.push_back(false);
+    } else {
+        ordinal = free_ordinals_.back();
+        free_ordinals_.pop_back();
+        external_ids_[ordinal] = document_id;
+        removed_[ordinal] = false;
+    }
+    ordinals_.emplace(document_id, ordinal);
+    return ordinal;
+}
+
+SearchServer::ParsedDocument SearchServer::ParseDocument(const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) const {
+    const std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
+    std::map<std::string_view, uint32_t> word_counts;
     for (const std::string_view word : words) {
-        index_[std::string(word)][document_id] += tf_one_word;
-        freqs_of_words[std::string(word)] += tf_one_word;
+        ++word_counts[word];
     }
-    documents_info_.emplace(document_id, DocumentInfo{ ComputeAverageRating(ratings), status, freqs_of_words, document_words });
-    document_ids_.insert(document_id);
+    return { ComputeAverageRating(ratings), status, static_cast<int>(words.size()), std::move(word_counts) };
+}
+
+double SearchServer::ComputeTermFreq(uint32_t count, int word_count) {
+    return static_cast<double>(count) / word_count;
+}
+
+uint32_t SearchServer::InsertTerm(const std::string_view word) {
+    if (const auto term_id = term_ids_.find(word); term_id != term_ids_.end()) {
+        return term_id->second;
+    }
+    const auto term = index_.emplace(std::piecewise_construct, std::forward_as_tuple(word), std::forward_as_tuple()).first;
+    uint32_t term_id = static_cast<uint32_t>(terms_.size());
+    if (free_term_ids_.empty()) {
+        terms_.push_back(term);
+        live_document_freqs_.push_back(0);
+    } else {
+        term_id = free_term_ids_.back();
+        free_term_ids_.pop_back();
+        terms_[term_id] = term;
+        live_document_freqs_[term_id] = 0;
+    }
+    term_ids_.emplace(term->first, term_id);
+    if (cold_tier_) {
+        if (term_id == cold_tier_->locations.size()) {
+            cold_tier_->locations.emplace_back();
+            cold_tier_->reads.emplace_back(0);
+        } else {
+            cold_tier_->reads[term_id].store(0, std::memory_order_relaxed);
+        }
+    }
+    return term_id;
+}
+
+void SearchServer::EraseTerm(uint32_t term_id) {
+    const auto term = terms_[term_id];
+    if (cold_tier_ && cold_tier_->locations[term_id].count > 0) {
+        cold_tier_->file->Release(cold_tier_->locations[term_id]);
+        cold_tier_->locations[term_id] = {};
+    }
+    term_ids_.erase(term->first);
+    index_.erase(term);
+    terms_[term_id] = index_.end();
+    free_term_ids_.push_back(term_id);
+}
+
+void SearchServer::AddLiveDocumentFreq(uint32_t term_id, int delta) {
+    uint32_t& document_freq = live_document_freqs_[term_id];
+    const bool was_live = document_freq > 0;
+    CountPostingLength(document_freq, document_freq + delta);
+    document_freq += delta;
+    if (fuzzy_index_ && was_live != (document_freq > 0)) {
+        if (was_live) {
+            fuzzy_index_->RemoveWord(terms_[term_id]->first);
+        } else {
+            fuzzy_index_->AddWord(terms_[term_id]->first);
+        }
+    }
+}
+
+void SearchServer::CountPostingLength(size_t old_length, size_t new_length) {
+    // Bucket of a length is the index of its highest set bit
+    const auto get_bucket = [](size_t length) {
+        size_t bucket = 0;
+        while (length >>= 1) {
+            ++bucket;
+        }
+        return bucket;
+    };
+    if (old_length > 0) {
+        --posting_length_histogram_[get_bucket(old_length)];
+    }
+    if (new_length > 0) {
+        const size_t bucket = get_bucket(new_length);
+        if (bucket >= posting_length_histogram_.size()) {
+            posting_length_histogram_.resize(bucket + 1);
+        }
+        ++posting_length_histogram_[bucket];
+    }
+    while (!posting_length_histogram_.empty() && posting_length_histogram_.back() == 0) {
+        posting_length_histogram_.pop_back();
+    }
+}
+
+void SearchServer::CountStatus(DocumentStatus old_status, DocumentStatus new_status) {
+    --status_counts_[old_status];
+    ++status_counts_[new_status];
+}
+
+SearchServer::DocumentInfo SearchServer::StoreDocumentInfo(const ParsedDocument& parsed_document, std::vector<TermEntry> term_entries) {
+    std::sort(term_entries.begin(), term_entries.end(), [](const TermEntry& lhs, const TermEntry& rhs) {
+        return lhs.term_id < rhs.term_id;
+    });
+    const size_t terms_offset = forward_index_.size();
+    forward_index_.insert(forward_index_.end(), term_entries.begin(), term_entries.end());
+    return { parsed_document.rating, parsed_document.status, parsed_document.word_count, terms_offset, static_cast<uint32_t>(term_entries.size()) };
+}
+
+std::pair<std::pmr::vector<SearchServer::TermEntry>::const_iterator, std::pmr::vector<SearchServer::TermEntry>::const_iterator> SearchServer::GetTermEntries(const DocumentInfo& document_info) const {
+    const auto first = forward_index_.cbegin() + document_info.terms_offset;
+    return { first, first + document_info.term_count };
+}
+
+const SearchServer::TermEntry* SearchServer::FindTermEntry(const DocumentInfo& document_info, const std::string_view word) const {
+    const auto term_id = term_ids_.find(word);
+    if (term_id == term_ids_.end()) {
+        return nullptr;
+    }
+    const auto [first, last] = GetTermEntries(document_info);
+    const auto entry = std::lower_bound(first, last, term_id->second, [](const TermEntry& entry, uint32_t value) {
+        return entry.term_id < value;
+    });
+    return entry != last && entry->term_id == term_id->second ? &*entry : nullptr;
+}
+
+void SearchServer::CompactForwardIndexIfNeeded() {
+    if (forward_index_garbage_ * 2 <= forward_index_.size()) {
+        return;
+    }
+    std::pmr::vector<TermEntry> forward_index(arena_->GetResource());
+    forward_index.reserve(forward_index_.size() - forward_index_garbage_);
+    const auto relocate = [this, &forward_index](DocumentInfo& document_info) {
+        const auto [first, last] = GetTermEntries(document_info);
+        document_info.terms_offset = forward_index.size();
+        forward_index.insert(forward_index.end(), first, last);
+    };
+    // Live and tombstoned documents keep their entries, free ordinals have none
+    for (uint32_t ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        if (external_ids_[ordinal] >= 0) {
+            relocate(documents_[ordinal]);
+        }
+    }
+    forward_index_ = std::move(forward_index);
+    forward_index_garbage_ = 0;
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, const DocumentStatus& status) const {
-    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) { return status == document_status; });
+    return FindTopDocuments<TfIdfScorer>(std::execution::seq, raw_query, status);
+}
+
+void SearchServer::EnableFuzzySearch(int max_edit_distance) {
+    if (max_edit_distance < 1) {
+        throw std::invalid_argument("Edit distance must be positive");
+    }
+    fuzzy_index_.emplace(max_edit_distance);
+    for (auto term = index_.cbegin(); term != index_.cend(); ++term) {
+        if (GetDocumentFreq(term) > 0) {
+            fuzzy_index_->AddWord(term->first);
+        }
+    }
+}
+
+void SearchServer::DisableFuzzySearch() {
+    fuzzy_index_.reset();
+}
+
+void SearchServer::EnableResultCache(size_t capacity, size_t shard_count) {
+    result_cache_ = std::make_unique<QueryResultCache>(capacity, shard_count);
+}
+
+void SearchServer::DisableResultCache() {
+    result_cache_.reset();
+}
+
+QueryResultCache::Stats SearchServer::GetResultCacheStats() const {
+    return result_cache_ ? result_cache_->GetStats() : QueryResultCache::Stats{};
+}
+
+void SearchServer::EnablePostingCache(size_t capacity, size_t shard_count) {
+    posting_cache_ = std::make_unique<PostingCache>(capacity, shard_count);
+}
+
+void SearchServer::DisablePostingCache() {
+    posting_cache_.reset();
+}
+
+PostingCache::Stats SearchServer::GetPostingCacheStats() const {
+    return posting_cache_ ? posting_cache_->GetStats() : PostingCache::Stats{};
+}
+
+IndexArena::Stats SearchServer::GetIndexMemoryStats() const {
+    return arena_->GetStats();
+}
+
+namespace {
+// Parent, child and colour fields of a red-black tree node, the layout of std::map and std::set
+constexpr size_t TREE_NODE_LINKS_SIZE = 4 * sizeof(void*);
+// Next pointer and cached hash of an unordered container node
+constexpr size_t HASH_NODE_LINKS_SIZE = 2 * sizeof(void*);
+constexpr size_t POSTING_NODE_SIZE = sizeof(std::pair<const uint32_t, double>) + TREE_NODE_LINKS_SIZE;
+
+size_t GetStringHeapSize(const std::string& string) {
+    return string.capacity() > std::string().capacity() ? string.capacity() + 1 : 0;
+}
+}
+
+SearchServer::MemoryStats SearchServer::GetMemoryStats() const {
+    MemoryStats stats;
+    size_t posting_count = 0;
+    for (const auto& [word, postings] : index_) {
+        posting_count += postings.size();
+    }
+    stats.postings = posting_count * POSTING_NODE_SIZE;
+    stats.forward_index = forward_index_.capacity() * sizeof(TermEntry);
+    const IndexArena::Stats arena_stats = arena_->GetStats();
+    stats.vocabulary = arena_stats.bytes_used - std::min(arena_stats.bytes_used, stats.postings + stats.forward_index);
+    stats.index_reserve = arena_stats.bytes_reserved - arena_stats.bytes_used;
+    stats.documents = GetDocumentsMemory();
+    stats.stop_words = stop_words_memory_;
+    stats.caches = GetPostingCacheStats().cached_postings * sizeof(PostingCache::Posting)
+        + GetResultCacheStats().size * MAX_RESULT_DOCUMENT_COUNT * sizeof(Document);
+    return stats;
+}
+
+SearchServer::IndexStatistics SearchServer::GetIndexStatistics(size_t heaviest_term_count) const {
+    IndexStatistics statistics;
+    // Every term with live documents is in exactly one histogram bucket
+    statistics.vocabulary_size = std::accumulate(posting_length_histogram_.begin(), posting_length_histogram_.end(), size_t{ 0 });
+    const CorpusStatistics corpus = GetCorpusStatistics();
+    statistics.document_count = corpus.document_count;
+    statistics.average_document_length = corpus.average_document_length;
+    statistics.tombstone_count = tombstones_.size();
+    statistics.posting_length_histogram = posting_length_histogram_;
+    for (const auto& [status, count] : status_counts_) {
+        if (count > 0) {
+            statistics.documents_by_status.emplace(status, count);
+        }
+    }
+
+    // Min-heap of the heaviest terms seen so far
+    using TermLength = std::pair<size_t, std::string_view>;
+    std::vector<TermLength> heaviest;
+    heaviest.reserve(heaviest_term_count + 1);
+    if (heaviest_term_count > 0) {
+        for (auto term = index_.begin(); term != index_.end(); ++term) {
+            heaviest.emplace_back(GetDocumentFreq(term), term->first);
+            std::push_heap(heaviest.begin(), heaviest.end(), std::greater<>());
+            if (heaviest.size() > heaviest_term_count) {
+                std::pop_heap(heaviest.begin(), heaviest.end(), std::greater<>());
+                heaviest.pop_back();
+            }
+        }
+    }
+    std::sort_heap(heaviest.begin(), heaviest.end(), std::greater<>());
+    for (const auto& [length, term] : heaviest) {
+        statistics.heaviest_terms.emplace_back(std::string(term), length);
+    }
+    return statistics;
+}
+
+void SearchServer::EnableMemoryBudget(size_t budget) {
+    memory_budget_ = budget;
+}
+
+void SearchServer::DisableMemoryBudget() {
+    memory_budget_.reset();
+}
+
+size_t SearchServer::GetStorageMemory() const {
+    return arena_->GetStats().bytes_reserved + GetDocumentsMemory() + stop_words_memory_;
+}
+
+size_t SearchServer::GetDocumentsMemory() const {
+    return ordinals_.bucket_count() * sizeof(void*)
+        + ordinals_.size() * (sizeof(std::pair<const int, uint32_t>) + HASH_NODE_LINKS_SIZE)
+        + document_ids_.size() * (sizeof(int) + TREE_NODE_LINKS_SIZE)
+        + external_ids_.capacity() * sizeof(int)
+        + documents_.capacity() * sizeof(DocumentInfo)
+        + removed_.capacity() / 8
+        + (free_ordinals_.capacity() + tombstones_.capacity()) * sizeof(uint32_t);
+}
+
+size_t SearchServer::ComputeStopWordsMemory() const {
+    size_t bytes = 0;
+    for (const std::string& stop_word : stop_words_) {
+        bytes += sizeof(std::string) + TREE_NODE_LINKS_SIZE + GetStringHeapSize(stop_word);
+    }
+    return bytes;
+}
+
+bool SearchServer::IsMemoryBudgetExceeded() const {
+    return memory_budget_ && GetStorageMemory() >= *memory_budget_;
+}
+
+void SearchServer::EnableTieredPostings(const std::string& path, size_t resident_bytes) {
+    DisableTieredPostings();
+    // Created before the tier, so a failure leaves the server without one
+    auto file = std::make_unique<ColdPostingFile>(path);
+    cold_tier_ = std::make_unique<ColdTier>();
+    cold_tier_->file = std::move(file);
+    cold_tier_->resident_bytes = resident_bytes;
+    cold_tier_->locations.resize(terms_.size());
+    for (size_t term_id = 0; term_id < terms_.size(); ++term_id) {
+        cold_tier_->reads.emplace_back(0);
+    }
+    RebalanceTiers();
+}
+
+void SearchServer::DisableTieredPostings() {
+    if (!cold_tier_) {
+        return;
+    }
+    for (uint32_t term_id = 0; term_id < terms_.size(); ++term_id) {
+        if (cold_tier_->locations[term_id].count > 0) {
+            PromoteTerm(term_id);
+        }
+    }
+    cold_tier_.reset();
+}
+
+void SearchServer::RebalanceTiers() {
+    if (!cold_tier_) {
+        return;
+    }
+    struct TermReads {
+        uint32_t term_id;
+        uint32_t reads;
+        size_t document_freq;
+    };
+    std::vector<TermReads> terms;
+    for (uint32_t term_id = 0; term_id < terms_.size(); ++term_id) {
+        if (terms_[term_id] != index_.end()) {
+            // Tombstoned postings take memory too, so the stored posting count sizes a term
+            const size_t cold_count = cold_tier_->locations[term_id].count;
+            const size_t posting_count = cold_count > 0 ? cold_count : terms_[term_id]->second.size();
+            terms.push_back({ term_id, cold_tier_->reads[term_id].load(std::memory_order_relaxed), posting_count });
+        }
+    }
+    // Most read terms first, and among equally read ones the shorter lists, which keep more terms resident
+    std::sort(terms.begin(), terms.end(), [](const TermReads& lhs, const TermReads& rhs) {
+        return lhs.reads != rhs.reads ? lhs.reads > rhs.reads : lhs.document_freq < rhs.document_freq;
+    });
+
+    std::vector<uint32_t> promoted;
+    size_t resident_bytes = 0;
+    for (const TermReads& term : terms) {
+        const bool is_cold = cold_tier_->locations[term.term_id].count > 0;
+        const size_t bytes = term.document_freq * POSTING_NODE_SIZE;
+        if (resident_bytes + bytes <= cold_tier_->resident_bytes) {
+            resident_bytes += bytes;
+            if (is_cold) {
+                promoted.push_back(term.term_id);
+            }
+        } else if (!is_cold) {
+            DemoteTerm(term.term_id);
+        }
+    }
+    // Promotions go after all demotions, so memory does not peak above the budget
+    for (const uint32_t term_id : promoted) {
+        PromoteTerm(term_id);
+    }
+    for (std::atomic<uint32_t>& reads : cold_tier_->reads) {
+        reads.store(reads.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+    }
+    RewriteColdFileIfNeeded();
+}
+
+SearchServer::TierStats SearchServer::GetTierStats() const {
+    TierStats stats;
+    if (!cold_tier_) {
+        stats.resident_terms = index_.size();
+        return stats;
+    }
+    for (uint32_t term_id = 0; term_id < terms_.size(); ++term_id) {
+        if (terms_[term_id] == index_.end()) {
+            continue;
+        }
+        const size_t cold_postings = cold_tier_->locations[term_id].count;
+        ++(cold_postings > 0 ? stats.cold_terms : stats.resident_terms);
+        stats.cold_postings += cold_postings;
+    }
+    stats.page_ins = cold_tier_->page_ins.load(std::memory_order_relaxed);
+    stats.promotions = cold_tier_->promotions;
+    stats.demotions = cold_tier_->demotions;
+    return stats;
+}
+
+std::optional<SearchServer::ColdPostings> SearchServer::ReadColdPostings(TermIndex::const_iterator term) const {
+    if (!cold_tier_) {
+        return std::nullopt;
+    }
+    const uint32_t term_id = term_ids_.find(term->first)->second;
+    cold_tier_->reads[term_id].fetch_add(1, std::memory_order_relaxed);
+    const ColdPostingFile::Location& location = cold_tier_->locations[term_id];
+    if (location.count == 0) {
+        return std::nullopt;
+    }
+    cold_tier_->page_ins.fetch_add(1, std::memory_order_relaxed);
+    const ColdPostingFile::Record* records = cold_tier_->file->GetRecords(location);
+    return ColdPostings{ records, records + location.count };
+}
+
+SearchServer::Postings::const_iterator SearchServer::LowerBound(const Postings& postings, uint32_t ordinal) {
+    return postings.lower_bound(ordinal);
+}
+
+const ColdPostingFile::Record* SearchServer::LowerBound(const ColdPostings& postings, uint32_t ordinal) {
+    return std::lower_bound(postings.begin(), postings.end(), ordinal, [](const ColdPostingFile::Record& record, uint32_t value) {
+        return record.ordinal < value;
+    });
+}
+
+size_t SearchServer::GetDocumentFreq(TermIndex::const_iterator term) const {
+    return live_document_freqs_[term_ids_.find(term->first)->second];
+}
+
+SearchServer::Postings& SearchServer::GetResidentPostings(uint32_t term_id) {
+    if (cold_tier_ && cold_tier_->locations[term_id].count > 0) {
+        PromoteTerm(term_id);
+    }
+    return terms_[term_id]->second;
+}
+
+void SearchServer::PromoteTerm(uint32_t term_id) {
+    ColdPostingFile::Location& location = cold_tier_->locations[term_id];
+    Postings& postings = terms_[term_id]->second;
+    const ColdPostingFile::Record* records = cold_tier_->file->GetRecords(location);
+    for (size_t i = 0; i < location.count; ++i) {
+        postings.emplace_hint(postings.end(), records[i].ordinal, records[i].term_freq);
+    }
+    cold_tier_->file->Release(location);
+    location = {};
+    ++cold_tier_->promotions;
+}
+
+void SearchServer::DemoteTerm(uint32_t term_id) {
+    Postings& postings = terms_[term_id]->second;
+    if (postings.empty()) {
+        return;
+    }
+    std::vector<ColdPostingFile::Record> records;
+    records.reserve(postings.size());
+    for (const auto& [ordinal, tf] : postings) {
+        records.push_back({ ordinal, tf });
+    }
+    cold_tier_->locations[term_id] = cold_tier_->file->Append(records);
+    postings.clear();
+    ++cold_tier_->demotions;
+}
+
+void SearchServer::RewriteColdFileIfNeeded() {
+    const ColdPostingFile& old_file = *cold_tier_->file;
+    if (old_file.GetGarbageCount() * 2 <= old_file.GetRecordCount()) {
+        return;
+    }
+    const std::string path = old_file.GetPath();
+    auto file = std::make_unique<ColdPostingFile>(path + ".next");
+    for (ColdPostingFile::Location& location : cold_tier_->locations) {
+        if (location.count == 0) {
+            continue;
+        }
+        const ColdPostingFile::Record* records = old_file.GetRecords(location);
+        location = file->Append(std::vector<ColdPostingFile::Record>(records, records + location.count));
+    }
+    // The old file removes itself when destroyed, then the new one takes its name
+    cold_tier_->file = std::move(file);
+    cold_tier_->file->MoveTo(path);
+}
+
+std::shared_ptr<const PostingCache::PostingList> SearchServer::GetFilteredPostings(const std::string_view word, DocumentStatus status) const {
+    std::string key(word);
+    key += '|';
+    key += std::to_string(static_cast<int>(status));
+    if (auto cached_postings = posting_cache_->Get(key, index_generation_)) {
+        return cached_postings;
+    }
+
+    const auto matched_word = index_.find(word);
+    if (matched_word == index_.end() || GetDocumentFreq(matched_word) == 0) {
+        return nullptr;
+    }
+    std::shared_ptr<const PostingCache::PostingList> posting_list;
+    VisitPostings(matched_word, [&](const auto& postings) {
+        posting_list = BuildFilteredPostings(postings, GetDocumentFreq(matched_word), status);
+    });
+    posting_cache_->Put(key, index_generation_, posting_list);
+    return posting_list;
+}
+
+SearchServer::QueryBatch SearchServer::PrepareQueryBatch(const std::vector<std::string_view>& raw_queries, DocumentStatus status) const {
+    std::vector<size_t> query_indexes(raw_queries.size());
+    std::iota(query_indexes.begin(), query_indexes.end(), 0);
+    std::vector<Query> parsed_queries(raw_queries.size());
+    std::vector<std::string> normalised_queries(raw_queries.size());
+    ForEachParallel(query_indexes.begin(), query_indexes.end(), [&](size_t query_index) {
+        parsed_queries[query_index] = ParseQuery(raw_queries[query_index]);
+        normalised_queries[query_index] = SerializeQuery(parsed_queries[query_index]);
+    });
+
+    QueryBatch batch;
+    batch.distinct_query_of_query.reserve(raw_queries.size());
+    std::vector<Query> queries;
+    std::unordered_map<std::string_view, size_t> distinct_queries;
+    for (size_t query_index = 0; query_index < parsed_queries.size(); ++query_index) {
+        const auto [position, inserted] = distinct_queries.emplace(normalised_queries[query_index], queries.size());
+        if (inserted) {
+            queries.push_back(std::move(parsed_queries[query_index]));
+        }
+        batch.distinct_query_of_query.push_back(position->second);
+    }
+
+    // Number the distinct terms of the batch; prefixes get their own numbering
+    // as "cat*" and "cat" expand to different posting lists
+    batch.plus_terms_of_query.resize(queries.size());
+    batch.minus_terms_of_query.resize(queries.size());
+    std::map<std::string_view, size_t> plus_words, plus_prefixes, minus_words, minus_prefixes;
+    const auto number_terms = [](const std::vector<std::string_view>& words, std::map<std::string_view, size_t>& numbers, std::vector<size_t>& terms_of_query) {
+        for (const std::string_view word : words) {
+            terms_of_query.push_back(numbers.emplace(word, numbers.size()).first->second);
+        }
+    };
+    for (size_t query_index = 0; query_index < queries.size(); ++query_index) {
+        number_terms(queries[query_index].plus_words, plus_words, batch.plus_terms_of_query[query_index]);
+        number_terms(queries[query_index].minus_words, minus_words, batch.minus_terms_of_query[query_index]);
+    }
+    for (size_t query_index = 0; query_index < queries.size(); ++query_index) {
+        std::vector<size_t> prefix_terms;
+        number_terms(queries[query_index].plus_prefixes, plus_prefixes, prefix_terms);
+        for (const size_t term : prefix_terms) {
+            batch.plus_terms_of_query[query_index].push_back(plus_words.size() + term);
+        }
+        prefix_terms.clear();
+        number_terms(queries[query_index].minus_prefixes, minus_prefixes, prefix_terms);
+        for (const size_t term : prefix_terms) {
+            batch.minus_terms_of_query[query_index].push_back(minus_words.size() + term);
+        }
+    }
+
+    // Every distinct posting list is traversed once, in parallel across terms
+    const std::shared_ptr<const PostingCache::PostingList> empty_posting_list = std::make_shared<PostingCache::PostingList>();
+    batch.plus_terms.resize(plus_words.size() + plus_prefixes.size());
+    std::vector<std::pair<std::string_view, size_t>> plus_terms(plus_words.begin(), plus_words.end());
+    for (const auto& [prefix, number] : plus_prefixes) {
+        plus_terms.emplace_back(prefix, plus_words.size() + number);
+    }
+    ForEachParallel(plus_terms.begin(), plus_terms.end(), [&](const std::pair<std::string_view, size_t>& term) {
+        std::shared_ptr<const PostingCache::PostingList> posting_list;
+        if (term.second >= plus_words.size()) {
+            const Postings postings = MergePrefixPostings(term.first);
+            posting_list = postings.empty() ? nullptr : BuildFilteredPostings(postings, postings.size(), status);
+        }
+        else if (posting_cache_) {
+            posting_list = GetFilteredPostings(term.first, status);
+        }
+        else {
+            const auto matched_word = index_.find(term.first);
+            if (matched_word != index_.end() && GetDocumentFreq(matched_word) > 0) {
+                VisitPostings(matched_word, [&](const auto& postings) {
+                    posting_list = BuildFilteredPostings(postings, GetDocumentFreq(matched_word), status);
+                });
+            }
+        }
+        batch.plus_terms[term.second] = posting_list ? posting_list : empty_posting_list;
+    });
+
+    batch.minus_terms.resize(minus_words.size() + minus_prefixes.size());
+    std::vector<std::pair<std::string_view, size_t>> minus_terms(minus_words.begin(), minus_words.end());
+    for (const auto& [prefix, number] : minus_prefixes) {
+        minus_terms.emplace_back(prefix, minus_words.size() + number);
+    }
+    ForEachParallel(minus_terms.begin(), minus_terms.end(), [&](const std::pair<std::string_view, size_t>& term) {
+        std::vector<uint32_t>& ordinals = batch.minus_terms[term.second];
+        if (term.second >= minus_words.size()) {
+            for (const auto& [ordinal, tf] : MergePrefixPostings(term.first)) {
+                ordinals.push_back(ordinal);
+            }
+        }
+        else if (const auto matched_word = index_.find(term.first); matched_word != index_.end()) {
+            VisitPostings(matched_word, [&](const auto& postings) {
+                for (const auto& [ordinal, tf] : postings) {
+                    ordinals.push_back(ordinal);
+                }
+            });
+        }
+    });
+
+    return batch;
+}
+
+void SearchServer::ResolveFuzzyWords(Query& query) const {
+    std::vector<std::string_view> plus_words;
+    plus_words.reserve(query.plus_words.size());
+    for (const std::string_view plus_word : query.plus_words) {
+        const auto matched_word = index_.find(plus_word);
+        if (matched_word != index_.end() && GetDocumentFreq(matched_word) > 0) {
+            plus_words.push_back(plus_word);
+            continue;
+        }
+        const std::vector<DeletionIndex::Candidate> candidates = fuzzy_index_->FindCandidates(plus_word);
+        if (candidates.empty()) {
+            plus_words.push_back(plus_word);
+            continue;
+        }
+        for (const DeletionIndex::Candidate& candidate : candidates) {
+            if (candidate.distance != candidates.front().distance) {
+                break;
+            }
+            plus_words.push_back(candidate.word);
+        }
+    }
+    query.plus_words = std::move(plus_words);
+}
+
+size_t SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    size_t removed_count = 0;
+    for (const int document_id : document_ids) {
+        const auto ordinal = ordinals_.find(document_id);
+        if (ordinal != ordinals_.end()) {
+            TombstoneDocument(ordinal);
+            ++removed_count;
+        }
+    }
+    if (removed_count > 0) {
+        ++index_generation_;
+        CompactIfNeeded();
+    }
+    return removed_count;
+}
+
+void SearchServer::Compact() {
+    if (tombstones_.empty()) {
+        return;
+    }
+    ++index_generation_;
+
+    // Every chunk of removed documents groups its ordinals by term, then every term is cleaned by a single worker
+    const size_t chunk_count = std::min(tombstones_.size(), GetParallelWorkerCount());
+    std::vector<std::map<uint32_t, std::vector<uint32_t>>> chunk_terms(chunk_count);
+    std::vector<size_t> chunks(chunk_count);
+    std::iota(chunks.begin(), chunks.end(), 0);
+    ForEachParallel(chunks.begin(), chunks.end(), [&](size_t chunk) {
+        const size_t first = tombstones_.size() * chunk / chunk_count;
+        const size_t last = tombstones_.size() * (chunk + 1) / chunk_count;
+        for (size_t position = first; position < last; ++position) {
+            const uint32_t ordinal = tombstones_[position];
+            const auto [first_entry, last_entry] = GetTermEntries(documents_[ordinal]);
+            for (auto entry = first_entry; entry != last_entry; ++entry) {
+                chunk_terms[chunk][entry->term_id].push_back(ordinal);
+            }
+        }
+    });
+
+    std::map<uint32_t, std::vector<const std::vector<uint32_t>*>> batch_terms;
+    for (const auto& terms : chunk_terms) {
+        for (const auto& [term_id, term_ordinals] : terms) {
+            batch_terms[term_id].push_back(&term_ordinals);
+        }
+    }
+    std::vector<const std::pair<const uint32_t, std::vector<const std::vector<uint32_t>*>>*> terms;
+    terms.reserve(batch_terms.size());
+    for (const auto& term : batch_terms) {
+        GetResidentPostings(term.first);
+        terms.push_back(&term);
+    }
+    ForEachParallel(terms.begin(), terms.end(), [this](const auto* term) {
+        Postings& postings = terms_[term->first]->second;
+        for (const std::vector<uint32_t>* term_ordinals : term->second) {
+            for (const uint32_t ordinal : *term_ordinals) {
+                postings.erase(ordinal);
+            }
+        }
+    });
+
+    for (const auto* term : terms) {
+        if (terms_[term->first]->second.empty()) {
+            EraseTerm(term->first);
+        }
+    }
+    // Ordinals without postings left are free for new documents
+    for (const uint32_t ordinal : tombstones_) {
+        forward_index_garbage_ += documents_[ordinal].term_count;
+        external_ids_[ordinal] = -1;
+        free_ordinals_.push_back(ordinal);
+    }
+    tombstones_.clear();
+    CompactForwardIndexIfNeeded();
+}
+
+size_t SearchServer::GetTombstoneCount() const {
+    return tombstones_.size();
+}
+
+void SearchServer::TombstoneDocument(std::unordered_map<int, uint32_t>::iterator ordinal) {
+    removed_[ordinal->second] = true;
+    tombstones_.push_back(ordinal->second);
+    const auto [first_entry, last_entry] = GetTermEntries(documents_[ordinal->second]);
+    for (auto entry = first_entry; entry != last_entry; ++entry) {
+        AddLiveDocumentFreq(entry->term_id, -1);
+    }
+    total_word_count_ -= documents_[ordinal->second].word_count;
+    --status_counts_[documents_[ordinal->second].status];
+    document_ids_.erase(ordinal->first);
+    ordinals_.erase(ordinal);
+}
+
+void SearchServer::CompactIfNeeded() {
+    if (tombstones_.size() * LIVE_DOCUMENTS_PER_TOMBSTONE > ordinals_.size()) {
+        Compact();
+    }
+}
+
+SearchServer::FlatAccumulator::FlatAccumulator(size_t ordinal_count) {
+    thread_local Storage thread_storage;
+    // A query nested in another one on the same thread gets arrays of its own
+    storage_ = thread_storage.in_use ? &own_storage_ : &thread_storage;
+    storage_->in_use = true;
+    if (storage_->relevances.size() < ordinal_count) {
+        storage_->relevances.resize(ordinal_count, 0.0);
+        storage_->matched.resize(ordinal_count, false);
+        storage_->excluded.resize(ordinal_count, false);
+    }
+}
+
+SearchServer::FlatAccumulator::~FlatAccumulator() {
+    for (const uint32_t ordinal : storage_->touched) {
+        storage_->relevances[ordinal] = 0.0;
+        storage_->matched[ordinal] = false;
+        storage_->excluded[ordinal] = false;
+    }
+    storage_->touched.clear();
+    storage_->in_use = false;
+}
+
+std::vector<std::pair<uint32_t, double>> SearchServer::FlatAccumulator::GetMatches() const {
+    std::vector<uint32_t> ordinals = storage_->touched;
+    std::sort(ordinals.begin(), ordinals.end());
+    ordinals.erase(std::unique(ordinals.begin(), ordinals.end()), ordinals.end());
+    std::vector<std::pair<uint32_t, double>> matches;
+    matches.reserve(ordinals.size());
+    for (const uint32_t ordinal : ordinals) {
+        if (storage_->matched[ordinal]) {
+            matches.emplace_back(ordinal, storage_->relevances[ordinal]);
+        }
+    }
+    return matches;
+}
+
+std::vector<std::pair<uint32_t, double>> SearchServer::SparseAccumulator::GetMatches() const {
+    std::vector<std::pair<uint32_t, double>> matches(relevances_.begin(), relevances_.end());
+    std::sort(matches.begin(), matches.end());
+    return matches;
+}
+
+void SearchServer::SetThreadPool(std::shared_ptr<ThreadPool> thread_pool) {
+    thread_pool_ = std::move(thread_pool);
+}
+
+const std::shared_ptr<ThreadPool>& SearchServer::GetThreadPool() const {
+    return thread_pool_;
+}
+
+ThreadPool& SearchServer::GetAsyncExecutor() const {
+    if (!thread_pool_) {
+        throw std::logic_error("No thread pool for asynchronous queries");
+    }
+    return *thread_pool_;
 }
 
 int SearchServer::GetDocumentCount() const {
-    return documents_info_.size();
+    return ordinals_.size();
 }
 
 std::set<std::string> SearchServer::GetStopWords() const {
     return stop_words_;
 }
 
-const std::map<std::string, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    const std::map<std::string, double>* freqs;
+std::map<std::string, double> SearchServer::GetWordFrequencies(int document_id) const {
+    const DocumentInfo* document_info;
     try
     {
-        freqs = &documents_info_.at(document_id).freqs_of_words;
+        document_info = &documents_[GetOrdinal(document_id)];
     }
     catch (const std::out_of_range&)
     {
@@ -45,57 +1018,264 @@ const std::map<std::string, double>& SearchServer::GetWordFrequencies(int docume
         std::cerr << "No such ID"s << std::endl;
         throw;
     }
-    return *freqs;
+    std::map<std::string, double> freqs;
+    const auto [first, last] = GetTermEntries(*document_info);
+    for (auto entry = first; entry != last; ++entry) {
+        freqs.emplace(terms_[entry->term_id]->first, ComputeTermFreq(entry->count, document_info->word_count));
+    }
+    return freqs;
+}
+
+std::vector<uint32_t> SearchServer::GetDocumentTermIds(int document_id) const {
+    const auto [first, last] = GetTermEntries(documents_[GetOrdinal(document_id)]);
+    std::vector<uint32_t> term_ids(last - first);
+    std::transform(first, last, term_ids.begin(), [](const TermEntry& entry) {
+        return entry.term_id;
+    });
+    return term_ids;
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    document_ids_.erase(document_id);
-    const std::map<std::string, double>* words;
-    try
-    {
-        words = &documents_info_.at(document_id).freqs_of_words;
-    }
-    catch (const std::out_of_range&)
-    {
+    const auto ordinal = ordinals_.find(document_id);
+    if (ordinal == ordinals_.end()) {
         using namespace std::string_literals;
         std::cerr << "No such ID"s << std::endl;
         return;
     }
-    for (auto iterator = words->begin(); iterator != words->end(); iterator = std::next(iterator)) {
-        std::string word = iterator->first;
-        index_[word].erase(document_id);
-    }
-    documents_info_.erase(document_id);
+    ++index_generation_;
+    TombstoneDocument(ordinal);
+    CompactIfNeeded();
 }
 
 void SearchServer::RemoveDocument(std::execution::sequenced_policy, int document_id) {
     RemoveDocument(document_id);
 }
 
+// Removal only marks a tombstone, the parallel part is the term cleanup done by Compact
 void SearchServer::RemoveDocument(std::execution::parallel_policy, int document_id) {
-    const std::vector<std::string>* document_content;
-    try
-    {
-        document_content = &documents_info_.at(document_id).content;
+    RemoveDocument(document_id);
+}
+
+size_t SearchServer::EstimateQueryCost(const std::string_view raw_query) const {
+    return EstimateQueryCost(ParseQuery(raw_query));
+}
+
+size_t SearchServer::EstimateQueryCost(const Query& query) const {
+    size_t cost = 0;
+    const auto add_word_cost = [this, &cost](const std::string_view word) {
+        const auto matched_word = index_.find(word);
+        if (matched_word != index_.end()) {
+            cost += GetDocumentFreq(matched_word);
+        }
+    };
+    std::for_each(query.plus_words.begin(), query.plus_words.end(), add_word_cost);
+    std::for_each(query.minus_words.begin(), query.minus_words.end(), add_word_cost);
+    for (const auto* prefixes : { &query.plus_prefixes, &query.minus_prefixes }) {
+        for (const std::string_view prefix : *prefixes) {
+            const std::vector<std::string_view> terms = ExpandPrefix(prefix);
+            std::for_each(terms.begin(), terms.end(), add_word_cost);
+        }
     }
-    catch (const std::out_of_range&)
-    {
-        using namespace std::string_literals;
-        std::cerr << "No such ID"s << std::endl;
-        return;
+    return cost;
+}
+
+SearchServer::QueryPlan SearchServer::PlanQuery(const std::string_view raw_query) const {
+    return PlanQuery(ParseQuery(raw_query), static_cast<bool>(posting_cache_));
+}
+
+SearchServer::QueryPlan SearchServer::PlanQuery(const Query& query, bool use_filtered_postings) const {
+    const auto get_word_postings = [this](const std::string_view word) -> size_t {
+        const auto matched_word = index_.find(word);
+        return matched_word == index_.end() ? 0 : GetDocumentFreq(matched_word);
+    };
+    // Prefixes are estimated by their expanded terms, minus prefixes probe every one of them
+    size_t minus_term_count = query.minus_words.size();
+    const auto get_prefix_postings = [&](const std::string_view prefix, bool is_minus) {
+        size_t postings = 0;
+        const std::vector<std::string_view> terms = ExpandPrefix(prefix);
+        for (const std::string_view term : terms) {
+            postings += get_word_postings(term);
+        }
+        if (is_minus) {
+            minus_term_count += terms.size();
+        }
+        return postings;
+    };
+
+    std::vector<QueryPlan::Term> plus_terms;
+    for (const std::string_view word : query.plus_words) {
+        plus_terms.push_back({ std::string(word), false, false, get_word_postings(word) });
+    }
+    for (const std::string_view prefix : query.plus_prefixes) {
+        plus_terms.push_back({ std::string(prefix), false, true, get_prefix_postings(prefix, false) });
     }
+    std::vector<QueryPlan::Term> minus_terms;
+    for (const std::string_view word : query.minus_words) {
+        minus_terms.push_back({ std::string(word), true, false, get_word_postings(word) });
+    }
+    for (const std::string_view prefix : query.minus_prefixes) {
+        minus_terms.push_back({ std::string(prefix), true, true, get_prefix_postings(prefix, true) });
+    }
+    // Rare terms carry the highest idf, scoring them first keeps the best matches in results cut short by cancellation
+    const auto by_postings = [](const QueryPlan::Term& lhs, const QueryPlan::Term& rhs) {
+        return lhs.estimated_postings < rhs.estimated_postings;
+    };
+    std::stable_sort(plus_terms.begin(), plus_terms.end(), by_postings);
+    std::stable_sort(minus_terms.begin(), minus_terms.end(), by_postings);
 
-    std::vector<const std::string*> document_words(document_content->size());
-    std::transform(std::execution::par, document_content->begin(), document_content->end(), document_words.begin(), [](const auto& item){
-        return &item;
-    });
+    size_t plus_postings = 0;
+    for (const QueryPlan::Term& term : plus_terms) {
+        plus_postings += term.estimated_postings;
+    }
+    size_t minus_postings = 0;
+    for (const QueryPlan::Term& term : minus_terms) {
+        minus_postings += term.estimated_postings;
+    }
+
+    QueryPlan plan;
+    plan.estimated_candidates = std::min(plus_postings, ordinals_.size());
+    // Probing costs a binary search over a document's term entries per minus term and candidate
+    const size_t indexed_documents = ordinals_.size() + tombstones_.size();
+    const double average_term_count = indexed_documents == 0 ? 0.0 : static_cast<double>(forward_index_.size() - forward_index_garbage_) / indexed_documents;
+    const double probe_cost = static_cast<double>(plan.estimated_candidates) * minus_term_count * (1.0 + std::log2(1.0 + average_term_count));
+    if (minus_postings > 0 && probe_cost < minus_postings) {
+        plan.minus_word_strategy = MinusWordStrategy::PROBE_FORWARD_INDEX;
+        minus_postings = 0;
+    } else if (minus_postings <= plus_postings) {
+        // Excluded documents are kept for the whole query, so it pays off while minus postings do not outnumber the plus ones
+        plan.minus_word_strategy = MinusWordStrategy::EXCLUDE_BEFORE;
+    } else {
+        plan.minus_word_strategy = MinusWordStrategy::EXCLUDE_AFTER;
+    }
+    plan.accumulator = plan.estimated_candidates * SPARSE_ACCUMULATOR_RATIO < documents_.size() ? AccumulatorType::SPARSE : AccumulatorType::FLAT;
+    plan.pruning = use_filtered_postings ? PruningStrategy::FILTERED_POSTINGS : PruningStrategy::NONE;
+    plan.estimated_postings = plus_postings + minus_postings;
+
+    if (plan.minus_word_strategy == MinusWordStrategy::EXCLUDE_BEFORE) {
+        plan.terms = std::move(minus_terms);
+        plan.terms.insert(plan.terms.end(), plus_terms.begin(), plus_terms.end());
+    } else {
+        plan.terms = std::move(plus_terms);
+        plan.terms.insert(plan.terms.end(), minus_terms.begin(), minus_terms.end());
+    }
+    return plan;
+}
+
+std::vector<uint32_t> SearchServer::GetMinusTermIds(const QueryPlan& plan) const {
+    std::vector<uint32_t> term_ids;
+    const auto add_term = [this, &term_ids](const std::string_view word) {
+        if (const auto term_id = term_ids_.find(word); term_id != term_ids_.end()) {
+            term_ids.push_back(term_id->second);
+        }
+    };
+    for (const QueryPlan::Term& term : plan.terms) {
+        if (!term.is_minus) {
+            continue;
+        }
+        if (term.is_prefix) {
+            const std::vector<std::string_view> words = ExpandPrefix(term.word);
+            std::for_each(words.begin(), words.end(), add_term);
+        } else {
+            add_term(term.word);
+        }
+    }
+    std::sort(term_ids.begin(), term_ids.end());
+    term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
+    return term_ids;
+}
 
-    std::for_each(std::execution::par, document_words.begin(), document_words.end(), [this, &document_id](const std::string*& word){
-        index_[*word].erase(document_id);
+bool SearchServer::ContainsAnyTerm(const DocumentInfo& document_info, const std::vector<uint32_t>& term_ids) const {
+    const auto [first, last] = GetTermEntries(document_info);
+    return std::any_of(term_ids.begin(), term_ids.end(), [first = first, last = last](uint32_t term_id) {
+        const auto entry = std::lower_bound(first, last, term_id, [](const TermEntry& entry, uint32_t value) {
+            return entry.term_id < value;
+        });
+        return entry != last && entry->term_id == term_id;
     });
+}
+
+SearchServer::ExecutionStrategy SearchServer::ChooseExecutionStrategy(const std::string_view raw_query) const {
+    return ChooseExecutionStrategy(ParseQuery(raw_query));
+}
+
+SearchServer::ExecutionStrategy SearchServer::ChooseExecutionStrategy(const Query& query) const {
+    const size_t cost = EstimateQueryCost(query);
+    if (cost < adaptive_parallel_threshold_ || GetParallelWorkerCount() < 2) {
+        return ExecutionStrategy::SEQUENTIAL;
+    }
+
+    // Per-term parallelism is bounded by the longest posting list, so it only
+    // pays off when no single term carries most of the work
+    size_t longest_postings = 0;
+    for (const auto* words : { &query.plus_words, &query.minus_words }) {
+        for (const std::string_view word : *words) {
+            const auto matched_word = index_.find(word);
+            if (matched_word != index_.end()) {
+                longest_postings = std::max(longest_postings, GetDocumentFreq(matched_word));
+            }
+        }
+    }
+    const size_t term_count = query.plus_words.size() + query.minus_words.size() + query.plus_prefixes.size() + query.minus_prefixes.size();
+    if (term_count >= GetParallelWorkerCount() && longest_postings * 2 < cost) {
+        return ExecutionStrategy::PER_TERM_PARALLEL;
+    }
+    return ExecutionStrategy::DOCUMENT_RANGE_PARALLEL;
+}
+
+void SearchServer::CalibrateAdaptiveExecution() {
+    using Clock = std::chrono::steady_clock;
+    constexpr int SAMPLE_POSTINGS = 1 << 16;
+    constexpr int DISPATCH_REPEATS = 16;
+
+    std::map<int, double> postings;
+    for (int id = 0; id < SAMPLE_POSTINGS; ++id) {
+        postings.emplace_hint(postings.end(), id, 1.0 / (id + 1));
+    }
+    const auto scoring_start = Clock::now();
+    std::map<int, double> matched_index;
+    for (const auto& [id, tf] : postings) {
+        matched_index[id] += tf * 1.5;
+    }
+    const double nanoseconds_per_posting = std::max(1.0, static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - scoring_start).count())) / SAMPLE_POSTINGS;
+
+    std::vector<std::atomic<int>> counters(GetParallelWorkerCount() * 4);
+    const auto dispatch_start = Clock::now();
+    for (int repeat = 0; repeat < DISPATCH_REPEATS; ++repeat) {
+        ForEachParallel(counters.begin(), counters.end(), [](std::atomic<int>& counter) {
+            counter.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+    const double nanoseconds_per_dispatch = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - dispatch_start).count()) / DISPATCH_REPEATS;
 
-    document_ids_.erase(document_id);
-    documents_info_.erase(document_id);
+    // Parallel execution wins once the sequential work clearly outweighs the dispatch overhead
+    adaptive_parallel_threshold_ = std::max<size_t>(1024, static_cast<size_t>(4 * nanoseconds_per_dispatch / nanoseconds_per_posting));
+}
+
+void SearchServer::SetAdaptiveParallelThreshold(size_t estimated_postings) {
+    adaptive_parallel_threshold_ = estimated_postings;
+}
+
+size_t SearchServer::GetAdaptiveParallelThreshold() const {
+    return adaptive_parallel_threshold_;
+}
+
+size_t SearchServer::GetParallelWorkerCount() const {
+    return thread_pool_ ? thread_pool_->GetWorkerCount() : std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::vector<Document> SearchServer::SelectTopDocuments(std::vector<Document> matched_documents) const {
+    const double EPSILON = 1e-6;
+    const size_t top_count = std::min<size_t>(matched_documents.size(), MAX_RESULT_DOCUMENT_COUNT);
+    std::partial_sort(matched_documents.begin(), matched_documents.begin() + top_count, matched_documents.end(),
+              [&EPSILON](const Document& lhs, const Document& rhs) {
+                  return ((std::abs(lhs.relevance - rhs.relevance) < EPSILON) && lhs.rating > rhs.rating) || (lhs.relevance > rhs.relevance);
+              });
+    matched_documents.resize(top_count);
+    return matched_documents;
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(AdaptiveExecutionPolicy, const std::string_view raw_query, int document_id) const {
+    return MatchDocument(std::execution::seq, raw_query, document_id);
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view raw_query, int document_id) const {
@@ -104,8 +1284,19 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     std::set<std::string_view> matched_plus_words;
     bool contains_minus_word = false;
 
+    const DocumentInfo& document_info = documents_[GetOrdinal(document_id)];
+    const auto contains_word = [this, &document_info](const std::string_view word) {
+        return FindTermEntry(document_info, word) != nullptr;
+    };
+
     for (const std::string_view minus_word : query.minus_words) {
-        if (index_.find(std::string(minus_word)) != index_.end() && index_.at(std::string(minus_word)).count(document_id)) {
+        if (contains_word(minus_word)) {
+            contains_minus_word = true;
+        }
+    }
+    for (const std::string_view minus_prefix : query.minus_prefixes) {
+        const std::vector<std::string_view> terms = ExpandPrefix(minus_prefix);
+        if (std::any_of(terms.begin(), terms.end(), contains_word)) {
             contains_minus_word = true;
         }
     }
@@ -113,13 +1304,20 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     if (!contains_minus_word)
     {
         for (const std::string_view plus_word : query.plus_words) {
-            if (index_.find(std::string(plus_word)) != index_.end() && index_.at(std::string(plus_word)).count(document_id)) {
+            if (contains_word(plus_word)) {
                 matched_plus_words.emplace(plus_word);
             }
         }
+        for (const std::string_view plus_prefix : query.plus_prefixes) {
+            for (const std::string_view term : ExpandPrefix(plus_prefix)) {
+                if (contains_word(term)) {
+                    matched_plus_words.emplace(term);
+                }
+            }
+        }
     }
     std::vector<std::string_view> plus_words_vector(matched_plus_words.begin(), matched_plus_words.end());
-    return { plus_words_vector, documents_info_.at(document_id).status };
+    return { plus_words_vector, document_info.status };
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy, const std::string_view raw_query, int document_id) const {
@@ -129,30 +1327,41 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy, const std::string_view raw_query, int document_id) const {
     Query query = ParseQuery(raw_query, false);
 
-    const std::vector<std::string>* document_content;
-    try {
-        document_content = &documents_info_.at(document_id).content;
-    }
-    catch (std::out_of_range&) {
+    const auto ordinal = ordinals_.find(document_id);
+    if (ordinal == ordinals_.end()) {
         return { std::vector<std::string_view>(), DocumentStatus::REMOVED};
     }
+    const DocumentInfo& document_info = documents_[ordinal->second];
 
-    const bool contains_minus_words = std::any_of(std::execution::par, query.minus_words.begin(), query.minus_words.end(), [&document_content](const std::string_view minus_word){
-        return std::find(document_content->begin(), document_content->end(), minus_word) != document_content->end();
-    });
+    const auto contains_word = [this, &document_info](const std::string_view word) {
+        return FindTermEntry(document_info, word) != nullptr;
+    };
+    const auto contains_prefix = [this, &contains_word](const std::string_view prefix) {
+        const std::vector<std::string_view> terms = ExpandPrefix(prefix);
+        return std::any_of(terms.begin(), terms.end(), contains_word);
+    };
+
+    const bool contains_minus_words = std::any_of(query.minus_words.begin(), query.minus_words.end(), contains_word)
+        || std::any_of(query.minus_prefixes.begin(), query.minus_prefixes.end(), contains_prefix);
 
     std::vector<std::string_view> matched_plus_words;
 
     if(!contains_minus_words) {
         matched_plus_words.reserve(query.plus_words.size());
-        std::copy_if(std::execution::seq, query.plus_words.begin(), query.plus_words.end(), std::back_inserter(matched_plus_words), [&document_content](const std::string_view plus_word){
-            return std::find(document_content->begin(), document_content->end(), std::string(plus_word)) != document_content->end();
-        });
-        std::sort(std::execution::par, matched_plus_words.begin(), matched_plus_words.end());
-        matched_plus_words.erase(std::unique(std::execution::par, matched_plus_words.begin(), matched_plus_words.end()), matched_plus_words.end());
+        for (const std::string_view plus_word : query.plus_words) {
+            if (const TermEntry* entry = FindTermEntry(document_info, plus_word)) {
+                matched_plus_words.push_back(terms_[entry->term_id]->first);
+            }
+        }
+        for (const std::string_view plus_prefix : query.plus_prefixes) {
+            const std::vector<std::string_view> terms = ExpandPrefix(plus_prefix);
+            std::copy_if(terms.begin(), terms.end(), std::back_inserter(matched_plus_words), contains_word);
+        }
+        std::sort(matched_plus_words.begin(), matched_plus_words.end());
+        matched_plus_words.erase(std::unique(matched_plus_words.begin(), matched_plus_words.end()), matched_plus_words.end());
     }
 
-    return { matched_plus_words, documents_info_.at(document_id).status };
+    return { matched_plus_words, document_info.status };
 }
 
 auto SearchServer::begin() const -> std::set<int>::const_iterator {
@@ -172,6 +1381,7 @@ SearchServer::SearchServer(const std::string& stop_words) {
         }
         stop_words_.insert(word);
     }
+    stop_words_memory_ = ComputeStopWordsMemory();
 }
 
 SearchServer::SearchServer(const std::string_view stop_words) {
@@ -181,6 +1391,7 @@ SearchServer::SearchServer(const std::string_view stop_words) {
         }
         stop_words_.insert(std::string(word));
     }
+    stop_words_memory_ = ComputeStopWordsMemory();
 }
 
 bool SearchServer::IsStopWord(const std::string_view word) const {
@@ -240,26 +1451,100 @@ SearchServer::Query SearchServer::ParseQuery(const std::string_view text, bool s
             if (word.size() <= 1 || word[1] == '-') {
                 throw std::invalid_argument("two minuses or nothing after minus");
             }
-            query.minus_words.push_back(word.substr(1));
+            const std::string_view minus_word = word.substr(1);
+            if (IsPrefixWord(minus_word)) {
+                query.minus_prefixes.push_back(minus_word.substr(0, minus_word.size() - 1));
+            }
+            else {
+                query.minus_words.push_back(minus_word);
+            }
+        }
+        else if (IsPrefixWord(word)) {
+            query.plus_prefixes.push_back(word.substr(0, word.size() - 1));
         }
         else {
             query.plus_words.push_back(word);
         }
     }
 
-    if (sort_results) {
-        std::sort(query.plus_words.begin(), query.plus_words.end());
-        query.plus_words.erase(std::unique(query.plus_words.begin(), query.plus_words.end()), query.plus_words.end());
+    if (fuzzy_index_) {
+        ResolveFuzzyWords(query);
+    }
 
-        std::sort(query.minus_words.begin(), query.minus_words.end());
-        query.minus_words.erase(std::unique(query.minus_words.begin(), query.minus_words.end()), query.minus_words.end());
+    if (sort_results) {
+        for (std::vector<std::string_view>* words : { &query.plus_words, &query.minus_words, &query.plus_prefixes, &query.minus_prefixes }) {
+            std::sort(words->begin(), words->end());
+            words->erase(std::unique(words->begin(), words->end()), words->end());
+        }
     }
 
     return query;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string& word) const {
-    return std::log(static_cast<double>(documents_info_.size()) / index_.at(word).size());
+std::string SearchServer::SerializeQuery(const Query& query) {
+    std::string text;
+    const auto append_words = [&text](const std::vector<std::string_view>& words, char marker, std::string_view suffix) {
+        for (const std::string_view word : words) {
+            text += marker;
+            text += word;
+            text += suffix;
+            text += ' ';
+        }
+    };
+    append_words(query.plus_words, '+', "");
+    append_words(query.plus_prefixes, '+', "*");
+    append_words(query.minus_words, '-', "");
+    append_words(query.minus_prefixes, '-', "*");
+    return text;
+}
+
+bool SearchServer::IsPrefixWord(const std::string_view word) {
+    if (word.empty() || word.back() != '*') {
+        return false;
+    }
+    if (word.size() == 1) {
+        throw std::invalid_argument("nothing before asterisk");
+    }
+    return true;
+}
+
+std::vector<std::string_view> SearchServer::ExpandPrefix(const std::string_view prefix) const {
+    // index_ is ordered, so the terms sharing a prefix form one contiguous range
+    std::vector<std::string_view> terms;
+    for (auto it = index_.lower_bound(prefix); it != index_.end() && terms.size() < MAX_PREFIX_EXPANSION_COUNT; ++it) {
+        const std::string_view term = it->first;
+        if (term.substr(0, prefix.size()) != prefix) {
+            break;
+        }
+        if (GetDocumentFreq(it) > 0) {
+            terms.push_back(term);
+        }
+    }
+    return terms;
+}
+
+SearchServer::Postings SearchServer::MergePrefixPostings(const std::string_view prefix) const {
+    Postings postings;
+    for (const std::string_view term : ExpandPrefix(prefix)) {
+        VisitPostings(index_.find(term), [&](const auto& term_postings) {
+            for (const auto& [ordinal, tf] : term_postings) {
+                // Without removed documents the size of the merged list is its live document frequency
+                if (!removed_[ordinal]) {
+                    postings[ordinal] += tf;
+                }
+            }
+        });
+    }
+    return postings;
+}
+
+CorpusStatistics SearchServer::GetCorpusStatistics() const {
+    CorpusStatistics statistics;
+    statistics.document_count = ordinals_.size();
+    if (!ordinals_.empty()) {
+        statistics.average_document_length = static_cast<double>(total_word_count_) / ordinals_.size();
+    }
+    return statistics;
 }
 
 bool SearchServer::IsValidWord(const std::string_view word) {
@@ -268,11 +1553,3 @@ bool SearchServer::IsValidWord(const std::string_view word) {
         return c >= '\0' && c < ' ';
         });
 }
-
-auto SearchServer::documents_info_begin() -> std::map<int, DocumentInfo>::iterator {
-    return documents_info_.begin();
-}
-
-auto SearchServer::documents_info_end() -> std::map<int, DocumentInfo>::iterator {
-    return documents_info_.end();
-}
\ No newline at end of file
@@ -1,71 +1,419 @@
 ﻿#pragma once
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <deque>
+#include <exception>
 #include <execution>
 #include <map>
+#include <memory_resource>
+#include <memory>
 #include <numeric>
+#include <optional>
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "document.h"
 #include "string_processing.h"
 #include "log_duration.h"
 #include "concurrent_map.h"
+#include "deletion_index.h"
+#include "scoring.h"
+#include "query_cache.h"
+#include "posting_cache.h"
+#include "thread_pool.h"
+#include "query_cancellation.h"
+#include "index_arena.h"
+#include "cold_postings.h"
 
 
+// Thrown by AddDocument and AddDocuments once the memory budget of the server is used up
+class MemoryBudgetExceeded : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Execution policy tag for FindTopDocuments and MatchDocument that lets the server choose
+// sequential or parallel execution for every query from its estimated amount of work
+struct AdaptiveExecutionPolicy {};
+inline constexpr AdaptiveExecutionPolicy adaptive_execution{};
+
 class SearchServer {
 public:
+    enum class ExecutionStrategy {
+        SEQUENTIAL,
+        // Plus and minus words are processed in parallel, suits many similarly sized terms
+        PER_TERM_PARALLEL,
+        // The document id space is split between workers, suits queries dominated by one long posting list
+        DOCUMENT_RANGE_PARALLEL
+    };
+
+    // How the sequential executor applies minus words
+    enum class MinusWordStrategy {
+        // Documents with minus words are excluded before plus words are scored, so their postings are skipped
+        EXCLUDE_BEFORE,
+        // Documents with minus words are removed from the scored documents afterwards
+        EXCLUDE_AFTER,
+        // Minus word postings are not read, every scored document is looked up in the forward index instead
+        PROBE_FORWARD_INDEX
+    };
+
+    enum class AccumulatorType {
+        // Per-thread arrays over all ordinals
+        FLAT,
+        // Hash map of the scored documents only, for queries touching a small share of the corpus
+        SPARSE
+    };
+
+    enum class PruningStrategy {
+        NONE,
+        // Plus word postings come from the posting cache already filtered by status
+        FILTERED_POSTINGS
+    };
+
+    // Execution plan of a query chosen from the document frequencies of its terms
+    struct QueryPlan {
+        struct Term {
+            // Prefix terms are stored without the trailing '*'
+            std::string word;
+            bool is_minus = false;
+            bool is_prefix = false;
+            size_t estimated_postings = 0;
+        };
+
+        // In execution order: plus terms rarest first, minus terms before or after them
+        std::vector<Term> terms;
+        MinusWordStrategy minus_word_strategy = MinusWordStrategy::EXCLUDE_BEFORE;
+        AccumulatorType accumulator = AccumulatorType::FLAT;
+        PruningStrategy pruning = PruningStrategy::NONE;
+        // Postings of the terms the plan reads
+        size_t estimated_postings = 0;
+        size_t estimated_candidates = 0;
+    };
+
+    struct QueryExplanation {
+        // Work done for one term of the plan
+        struct Stage {
+            size_t estimated_postings = 0;
+            size_t actual_postings = 0;
+            // Postings skipped before scoring: of excluded documents or filtered out by status
+            size_t pruned_postings = 0;
+            std::chrono::nanoseconds duration{ 0 };
+        };
+
+        QueryPlan plan;
+        // Stage of every term of the plan, at the same position
+        std::vector<Stage> stages;
+        size_t matched_documents = 0;
+        std::chrono::nanoseconds duration{ 0 };
+    };
+
     struct DocumentInfo {
         int rating;
         DocumentStatus status;
-        std::map<std::string, double> freqs_of_words;
-        std::vector<std::string> content;
+        // Number of indexed (non-stop) words, the document length used by scorers. Length norms
+        // are not kept in a dense vector by ordinal: the BM25 norm depends on the average length,
+        // which every added or removed document changes, so stored norms would have to be
+        // recomputed for all documents. Scorers turn the length into the norm with one multiply-add
+        // and DocumentInfo is loaded for the filter anyway.
+        int word_count;
+        // Range of the document's term entries in the forward index
+        size_t terms_offset;
+        uint32_t term_count;
+    };
+
+    // Bytes held by each part of the server. Index parts come from the arena, the posting and
+    // container node sizes are estimates of the standard library layout.
+    struct MemoryStats {
+        // Terms of the inverted index with their id tables
+        size_t vocabulary = 0;
+        size_t postings = 0;
+        size_t forward_index = 0;
+        // Attributes of documents, id to ordinal maps and tombstones
+        size_t documents = 0;
+        size_t stop_words = 0;
+        // Entries of the result and posting caches
+        size_t caches = 0;
+        // Reserved by the arena pools but not in use
+        size_t index_reserve = 0;
+
+        size_t GetTotal() const {
+            return vocabulary + postings + forward_index + documents + stop_words + caches + index_reserve;
+        }
+    };
+
+    // Shape of the index. Every field counts live documents only: a posting list's length is its
+    // live document frequency, and terms whose postings all belong to removed documents are left out
+    // although their postings stay in the index until Compact.
+    struct IndexStatistics {
+        size_t vocabulary_size = 0;
+        size_t document_count = 0;
+        double average_document_length = 0.0;
+        size_t tombstone_count = 0;
+        // Element i is the number of terms with posting lists of 2^i to 2^(i+1) - 1 postings
+        std::vector<size_t> posting_length_histogram;
+        // Terms with the longest posting lists and their lengths, longest first
+        std::vector<std::pair<std::string, size_t>> heaviest_terms;
+        std::map<DocumentStatus, size_t> documents_by_status;
+    };
+
+    struct TierStats {
+        size_t resident_terms = 0;
+        size_t cold_terms = 0;
+        // Postings stored in the cold file, the file also holds released lists until it is rewritten
+        size_t cold_postings = 0;
+        // Cold posting lists read by queries
+        uint64_t page_ins = 0;
+        uint64_t promotions = 0;
+        uint64_t demotions = 0;
     };
 
 //    void AddDocument(int document_id, const std::string& document, DocumentStatus status, const std::vector<int>& ratings);
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Tokenises and indexes documents in parallel. Documents failing validation are skipped,
+    // the result holds the error of every document at its position, nullptr if it was added.
+    std::vector<std::exception_ptr> AddDocuments(const std::vector<DocumentToAdd>& documents);
 
-    template<typename TFilter>
+    // Replaces the text, status and rating of an existing document, only postings of terms whose
+    // frequency changed are touched; throws std::out_of_range for an unknown id
+    void UpdateDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Change only the document attributes and leave the index as it is
+    void UpdateDocumentStatus(int document_id, DocumentStatus status);
+    void UpdateDocumentRating(int document_id, const std::vector<int>& ratings);
+
+    // Scorer selects the relevance formula at compile time, see scoring.h
+    template<typename Scorer = TfIdfScorer, typename TFilter>
     std::vector<Document> FindTopDocuments(const std::string_view raw_query, TFilter filter) const;
     std::vector<Document> FindTopDocuments(const std::string_view raw_query, const DocumentStatus& status = DocumentStatus::ACTUAL) const;
+    template<typename Scorer>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, const DocumentStatus& status = DocumentStatus::ACTUAL) const;
 
-    template<typename ExecutionPolicy, typename TFilter>
+    template<typename Scorer = TfIdfScorer, typename ExecutionPolicy, typename TFilter>
     std::vector<Document> FindTopDocuments(ExecutionPolicy policy, const std::string_view raw_query, TFilter filter) const;
-    template<typename ExecutionPolicy>
+    template<typename Scorer = TfIdfScorer, typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy policy, const std::string_view raw_query, const DocumentStatus& status = DocumentStatus::ACTUAL) const;
 
+    // Ranks a whole batch of queries at once: queries equal after normalisation are ranked
+    // once, and the postings of every distinct term are filtered once and then scored in a
+    // single pass that adds each score to all the queries using the term
+    template<typename Scorer = TfIdfScorer>
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string_view>& raw_queries, DocumentStatus status = DocumentStatus::ACTUAL) const;
+    template<typename Scorer = TfIdfScorer>
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries, DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    // Versions that stop scoring once cancellation fires and return the best documents found so far
+    // flagged as partial. Minus words are still applied after that, and results are never cached.
+    template<typename Scorer = TfIdfScorer, typename TFilter>
+    SearchResult FindTopDocumentsWithin(const std::string_view raw_query, const QueryCancellation& cancellation, TFilter filter) const;
+    template<typename Scorer = TfIdfScorer>
+    SearchResult FindTopDocumentsWithin(const std::string_view raw_query, const QueryCancellation& cancellation, const DocumentStatus& status = DocumentStatus::ACTUAL) const;
+    template<typename Scorer = TfIdfScorer, typename ExecutionPolicy, typename TFilter>
+    SearchResult FindTopDocumentsWithin(ExecutionPolicy policy, const std::string_view raw_query, const QueryCancellation& cancellation, TFilter filter) const;
+    template<typename Scorer = TfIdfScorer, typename ExecutionPolicy>
+    SearchResult FindTopDocumentsWithin(ExecutionPolicy policy, const std::string_view raw_query, const QueryCancellation& cancellation, const DocumentStatus& status = DocumentStatus::ACTUAL) const;
+
+    // Asynchronous versions run on the thread pool set with SetThreadPool and throw std::logic_error
+    // without one. The server must not be modified while their results are pending.
+    template<typename Scorer = TfIdfScorer, typename TFilter>
+    std::future<std::vector<Document>> FindTopDocumentsAsync(std::string raw_query, TFilter filter) const;
+    template<typename Scorer = TfIdfScorer>
+    std::future<std::vector<Document>> FindTopDocumentsAsync(std::string raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+    template<typename Scorer = TfIdfScorer>
+    std::future<std::vector<std::vector<Document>>> FindTopDocumentsBatchAsync(std::vector<std::string> raw_queries, DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    // Number of postings ranking raw_query would traverse
+    size_t EstimateQueryCost(const std::string_view raw_query) const;
+
+    // Plan the sequential executor follows for raw_query filtered by status
+    QueryPlan PlanQuery(const std::string_view raw_query) const;
+    // Runs raw_query sequentially past the result cache and reports its plan with the
+    // estimated and actual postings and the time of every stage
+    template<typename Scorer = TfIdfScorer>
+    QueryExplanation Explain(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy, const std::string_view raw_query, int document_id) const;
+    // Matching looks each query word up in the document's sorted terms, too little work to go parallel,
+    // so par and adaptive_execution match sequentially too; par returns REMOVED for an unknown id
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy, const std::string_view raw_query, int document_id) const;
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(AdaptiveExecutionPolicy, const std::string_view raw_query, int document_id) const;
+
+    // Strategy adaptive_execution would use for raw_query
+    ExecutionStrategy ChooseExecutionStrategy(const std::string_view raw_query) const;
+    // Measures sequential scoring speed against parallel dispatch overhead on this machine
+    // and sets the amount of work from which adaptive_execution goes parallel. It is not run
+    // by default: until it or SetAdaptiveParallelThreshold is called, the threshold is a fixed
+    // 50000 estimated postings that was not measured on the machine
+    void CalibrateAdaptiveExecution();
+    void SetAdaptiveParallelThreshold(size_t estimated_postings);
+    size_t GetAdaptiveParallelThreshold() const;
+
+    // Plus words missing from the vocabulary are replaced by their closest terms within max_edit_distance
+    void EnableFuzzySearch(int max_edit_distance = 1);
+    void DisableFuzzySearch();
+
+    // Caches FindTopDocuments results of status-filtered queries; any AddDocument or
+    // RemoveDocument invalidates the cached entries
+    void EnableResultCache(size_t capacity, size_t shard_count = 16);
+    void DisableResultCache();
+    QueryResultCache::Stats GetResultCacheStats() const;
+
+    // Caches status-filtered postings of frequently queried terms, capacity counts postings
+    void EnablePostingCache(size_t capacity, size_t shard_count = 16);
+    void DisablePostingCache();
+    PostingCache::Stats GetPostingCacheStats() const;
+
+    // Memory taken by the inverted and forward indexes
+    IndexArena::Stats GetIndexMemoryStats() const;
+    // Walks the vocabulary to count postings, so it costs one pass over the terms
+    MemoryStats GetMemoryStats() const;
+    // Counters and the histogram are maintained by every modification, only the
+    // heaviest terms take a pass over the vocabulary
+    IndexStatistics GetIndexStatistics(size_t heaviest_term_count = 10) const;
+
+    // Once the server takes budget bytes, AddDocument throws MemoryBudgetExceeded and AddDocuments
+    // rejects its documents with it; a batch admitted under the budget may exceed it. Updates and
+    // removals are always allowed, memory of removed documents is reused after Compact.
+    void EnableMemoryBudget(size_t budget);
+    void DisableMemoryBudget();
+
+    // Keeps at most resident_bytes of postings in memory and demotes the rest to a memory-mapped
+    // file at path, which queries read in place. Terms read most by queries since the previous
+    // RebalanceTiers stay resident; modifying a cold term's postings promotes it first.
+    // Linux only, elsewhere it throws std::system_error and leaves the postings resident.
+    void EnableTieredPostings(const std::string& path, size_t resident_bytes);
+    // Promotes all terms and deletes the file
+    void DisableTieredPostings();
+    // Promotes and demotes terms by their reads and halves the read counts, meant to run
+    // periodically between modifications
+    void RebalanceTiers();
+    TierStats GetTierStats() const;
+
+    // Scoring of the par FindTopDocuments overloads, par RemoveDocument and batch execution runs
+    // on thread_pool when one is set, otherwise on the std::execution::par scheduler. Document
+    // matching and top document selection are sequential under every policy.
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+    const std::shared_ptr<ThreadPool>& GetThreadPool() const;
 
     int GetDocumentCount() const;
     std::set<std::string> GetStopWords() const;
-    const std::map<std::string, double>& GetWordFrequencies(int document_id) const;
+    std::map<std::string, double> GetWordFrequencies(int document_id) const;
+    // Sorted ids of the distinct words of a document, equal for documents with the same set of words
+    std::vector<uint32_t> GetDocumentTermIds(int document_id) const;
 
+    // Removed documents leave results at once while their postings stay in the index as tombstones
+    // until Compact. Removal walks the document's forward index entries to decrement the live
+    // document frequencies, so idf, prefixes and fuzzy matching stop counting it at once, and it
+    // runs Compact synchronously once tombstones exceed a quarter of the live documents.
     void RemoveDocument(int document_id);
     void RemoveDocument(std::execution::sequenced_policy, int document_id);
     void RemoveDocument(std::execution::parallel_policy, int document_id);
+    // Unknown and repeated ids are ignored, returns the number of documents removed
+    size_t RemoveDocuments(const std::vector<int>& document_ids);
+    // Drops the postings of removed documents, with terms cleaned in parallel, and the terms left without postings
+    void Compact();
+    size_t GetTombstoneCount() const;
 
     auto begin() const->std::set<int>::const_iterator;
     auto end() const->std::set<int>::const_iterator;
 
-    auto documents_info_begin() -> std::map<int, DocumentInfo>::iterator;
-    auto documents_info_end() -> std::map<int, DocumentInfo>::iterator;
-
     SearchServer();
     explicit SearchServer(const std::string& stop_words);
     explicit SearchServer(const std::string_view stop_words);
     template<typename T>
     SearchServer(const T& stop_words_container);
+    // Index containers allocate from arena_ and refer to each other by iterators and views,
+    // so a moved-from server would be left allocating from an arena it no longer owns
+    SearchServer(const SearchServer&) = delete;
+    SearchServer& operator=(const SearchServer&) = delete;
+    SearchServer(SearchServer&&) = delete;
+    SearchServer& operator=(SearchServer&&) = delete;
 
 private:
     const int MAX_RESULT_DOCUMENT_COUNT = 5;
+    // Number of postings scored between two checks of a query cancellation
+    static constexpr size_t CANCELLATION_CHECK_INTERVAL = 1024;
+    // Upper bound on vocabulary terms a single "prefix*" query word may expand to
+    const size_t MAX_PREFIX_EXPANSION_COUNT = 64;
+    // Compact runs once tombstones outnumber live documents divided by this
+    static constexpr size_t LIVE_DOCUMENTS_PER_TOMBSTONE = 4;
+    // Queries expected to score fewer than the ordinals divided by this use a sparse accumulator
+    static constexpr size_t SPARSE_ACCUMULATOR_RATIO = 64;
     std::set<std::string> stop_words_;
-    std::map<std::string, std::map<int, double>> index_;
+    // Stop words are fixed once constructed, so their memory is computed once for the budget checks
+    size_t stop_words_memory_ = 0;
+    // Postings are keyed by document ordinal
+    using Postings = std::pmr::map<uint32_t, double>;
+    using TermIndex = std::pmr::map<std::pmr::string, Postings, std::less<>>;
+
+    // Forward index entry: a word of a document and the number of its occurrences, tf is count / word_count
+    struct TermEntry {
+        uint32_t term_id;
+        uint32_t count;
+    };
+
+    // Declared ahead of the structures allocated from it, so it is destroyed after them. Teardown
+    // still walks every posting node; the arena only makes handing the memory back to the heap bulk
+    std::unique_ptr<IndexArena> arena_ = std::make_unique<IndexArena>();
+    TermIndex index_{ arena_->GetResource() };
+    // Vocabulary term of every term id, index_.end() for ids free for reuse
+    std::pmr::vector<TermIndex::iterator> terms_{ arena_->GetResource() };
+    std::pmr::unordered_map<std::string_view, uint32_t> term_ids_{ arena_->GetResource() };
+    std::pmr::vector<uint32_t> free_term_ids_{ arena_->GetResource() };
+    // Documents not removed that contain each term id. Postings of removed documents stay until Compact,
+    // so this and not the posting count is the document frequency of idf, fuzzy matching and prefixes
+    std::pmr::vector<uint32_t> live_document_freqs_{ arena_->GetResource() };
+    // Term entries of all documents, each document owns a contiguous range sorted by term id
+    std::pmr::vector<TermEntry> forward_index_{ arena_->GetResource() };
+    // Entries of replaced and compacted documents, forward_index_ is rewritten once they make up half of it
+    size_t forward_index_garbage_ = 0;
     std::set<int> document_ids_;
-    std::map<int, DocumentInfo> documents_info_;
+    // Documents live under dense ordinals: postings, the forward index, documents_ and the
+    // accumulators of scoring use ordinals, and only results are translated back to external ids
+    std::unordered_map<int, uint32_t> ordinals_;
+    // External id of every ordinal, -1 for ordinals free for reuse
+    std::vector<int> external_ids_;
+    std::vector<DocumentInfo> documents_;
+    // Set for ordinals of removed documents, both tombstoned and compacted ones
+    std::vector<bool> removed_;
+    std::vector<uint32_t> free_ordinals_;
+    // Sum of word_count over all documents, kept for the average document length
+    long long total_word_count_ = 0;
+    // Live documents by status and terms by live document frequency, see IndexStatistics
+    std::map<DocumentStatus, size_t> status_counts_;
+    std::vector<size_t> posting_length_histogram_;
+    std::optional<DeletionIndex> fuzzy_index_;
+    std::unique_ptr<QueryResultCache> result_cache_;
+    std::unique_ptr<PostingCache> posting_cache_;
+    std::shared_ptr<ThreadPool> thread_pool_;
+    std::optional<size_t> memory_budget_;
+
+    struct ColdTier {
+        std::unique_ptr<ColdPostingFile> file;
+        size_t resident_bytes = 0;
+        // Location of the postings of every term id in the file, empty for resident terms
+        std::vector<ColdPostingFile::Location> locations;
+        // Reads of every term id by queries, halved by every RebalanceTiers
+        std::deque<std::atomic<uint32_t>> reads;
+        std::atomic<uint64_t> page_ins{ 0 };
+        uint64_t promotions = 0;
+        uint64_t demotions = 0;
+    };
+    // Present while tiered postings are enabled; index_ keeps cold terms with empty postings
+    std::unique_ptr<ColdTier> cold_tier_;
+    // Estimated postings from which parallel execution pays off, see CalibrateAdaptiveExecution
+    size_t adaptive_parallel_threshold_ = 50000;
+    // Ordinals of removed documents whose postings are still in index_
+    std::vector<uint32_t> tombstones_;
+    // Bumped by every modification of the index, cached results of older generations are stale
+    uint64_t index_generation_ = 0;
 
     struct WordInfo
     {
@@ -84,23 +432,255 @@ private:
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
+    // Ordinal of a live document, throws std::out_of_range for an unknown id
+    uint32_t GetOrdinal(int document_id) const;
+    // Takes a free ordinal, or a new one, for a document being added
+    uint32_t AllocateOrdinal(int document_id);
+    void TombstoneDocument(std::unordered_map<int, uint32_t>::iterator ordinal);
+    // Bytes of the index, documents and stop words, without walking the vocabulary
+    size_t GetStorageMemory() const;
+    size_t GetDocumentsMemory() const;
+    size_t ComputeStopWordsMemory() const;
+    bool IsMemoryBudgetExceeded() const;
+    void CompactIfNeeded();
+
+    struct ParsedDocument {
+        int rating;
+        DocumentStatus status;
+        int word_count;
+        // Occurrences of every distinct word, the words point into the document text
+        std::map<std::string_view, uint32_t> word_counts;
+    };
+
+    // Validates and tokenises a document without touching the index
+    ParsedDocument ParseDocument(const std::string_view document, DocumentStatus status, const std::vector<int>& ratings) const;
+    static double ComputeTermFreq(uint32_t count, int word_count);
+
+    // Id of word, which is added to the vocabulary if it is new
+    uint32_t InsertTerm(const std::string_view word);
+    // Removes a term left without postings and frees its id
+    void EraseTerm(uint32_t term_id);
+    // The fuzzy index holds the terms with a positive live document frequency, and the
+    // posting length histogram follows the frequencies too
+    void AddLiveDocumentFreq(uint32_t term_id, int delta);
+    // Moves a term between posting length histogram buckets, length 0 stands for no term
+    void CountPostingLength(size_t old_length, size_t new_length);
+    void CountStatus(DocumentStatus old_status, DocumentStatus new_status);
+    // Appends the term entries to the forward index
+    DocumentInfo StoreDocumentInfo(const ParsedDocument& parsed_document, std::vector<TermEntry> term_entries);
+    std::pair<std::pmr::vector<TermEntry>::const_iterator, std::pmr::vector<TermEntry>::const_iterator> GetTermEntries(const DocumentInfo& document_info) const;
+    // Entry of word in the document, nullptr if the document does not contain it
+    const TermEntry* FindTermEntry(const DocumentInfo& document_info, const std::string_view word) const;
+    void CompactForwardIndexIfNeeded();
+
+    // Records of a cold posting list, read in place from the memory-mapped cold file and sorted by ordinal
+    struct ColdPostings {
+        const ColdPostingFile::Record* first = nullptr;
+        const ColdPostingFile::Record* last = nullptr;
+
+        const ColdPostingFile::Record* begin() const { return first; }
+        const ColdPostingFile::Record* end() const { return last; }
+    };
+    // Counts a read of the term and returns its cold records, nullopt for a resident term
+    std::optional<ColdPostings> ReadColdPostings(TermIndex::const_iterator term) const;
+    // Calls visitor with the term's resident Postings or its ColdPostings, both iterate as
+    // (ordinal, term_freq) pairs in ordinal order without copying a cold list
+    template<typename Visitor>
+    void VisitPostings(TermIndex::const_iterator term, Visitor visitor) const;
+    // First posting at or after ordinal
+    static Postings::const_iterator LowerBound(const Postings& postings, uint32_t ordinal);
+    static const ColdPostingFile::Record* LowerBound(const ColdPostings& postings, uint32_t ordinal);
+    // Live document frequency, postings of removed documents are not counted
+    size_t GetDocumentFreq(TermIndex::const_iterator term) const;
+    // Postings of a term for modification, a cold term is promoted first
+    Postings& GetResidentPostings(uint32_t term_id);
+    void PromoteTerm(uint32_t term_id);
+    void DemoteTerm(uint32_t term_id);
+    // Copies the cold postings into a new file once released lists make up half of it
+    void RewriteColdFileIfNeeded();
+
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        // Prefixes of "cat*"-style words, without the trailing '*'
+        std::vector<std::string_view> plus_prefixes;
+        std::vector<std::string_view> minus_prefixes;
     };
 
     Query ParseQuery(const std::string_view text, bool sort_results = true) const;
 
-    double ComputeWordInverseDocumentFreq(const std::string& word) const;
+    void ResolveFuzzyWords(Query& query) const;
+
+    // Canonical text of a parsed query, equal for queries that differ only in word order or repeats
+    static std::string SerializeQuery(const Query& query);
+
+    static bool IsPrefixWord(const std::string_view word);
+    // Vocabulary terms starting with prefix, at most MAX_PREFIX_EXPANSION_COUNT of them
+    std::vector<std::string_view> ExpandPrefix(const std::string_view prefix) const;
+    // Postings of all expanded terms merged into one virtual posting list
+    Postings MergePrefixPostings(const std::string_view prefix) const;
+
+    CorpusStatistics GetCorpusStatistics() const;
+
+    template<typename Iterator, typename Function>
+    void ForEachParallel(Iterator first, Iterator last, Function function) const;
+
+    ThreadPool& GetAsyncExecutor() const;
+
+    // Filter of the status overloads, its type lets FindAllDocuments serve postings from posting_cache_
+    struct StatusFilter {
+        DocumentStatus status;
 
-    template<typename TFilter>
+        bool operator()(int /*document_id*/, DocumentStatus document_status, int /*rating*/) const {
+            return status == document_status;
+        }
+    };
+
+    // Postings of word whose documents have the given status, nullptr if the word is not indexed
+    std::shared_ptr<const PostingCache::PostingList> GetFilteredPostings(const std::string_view word, DocumentStatus status) const;
+    template<typename TPostings>
+    std::shared_ptr<const PostingCache::PostingList> BuildFilteredPostings(const TPostings& postings, size_t document_freq, DocumentStatus status) const;
+
+    // Distinct queries and terms of a query batch with the term postings
+    struct QueryBatch {
+        // Position of each raw query's normalised form among the distinct queries
+        std::vector<size_t> distinct_query_of_query;
+        // Terms used by every distinct query
+        std::vector<std::shared_ptr<const PostingCache::PostingList>> plus_terms;
+        std::vector<std::vector<uint32_t>> minus_terms;
+        std::vector<std::vector<size_t>> plus_terms_of_query;
+        std::vector<std::vector<size_t>> minus_terms_of_query;
+    };
+
+    QueryBatch PrepareQueryBatch(const std::vector<std::string_view>& raw_queries, DocumentStatus status) const;
+
+    // Lets the scoring loop stop once cancellation fires; interrupted records that it did
+    struct ScoringControl {
+        const QueryCancellation* cancellation = nullptr;
+        std::atomic<bool> interrupted{ false };
+
+        bool ShouldStop() {
+            if (interrupted.load(std::memory_order_relaxed)) {
+                return true;
+            }
+            if (cancellation->IsCancelled()) {
+                interrupted.store(true, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+    };
+
+    // Relevance of the ordinals matched by a query. The arrays are reused by the queries of a thread
+    // and only touched entries are reset, so a query costs its postings rather than the corpus size.
+    class FlatAccumulator {
+    public:
+        explicit FlatAccumulator(size_t ordinal_count);
+        FlatAccumulator(const FlatAccumulator&) = delete;
+        FlatAccumulator& operator=(const FlatAccumulator&) = delete;
+        ~FlatAccumulator();
+
+        void Add(uint32_t ordinal, double score) {
+            if (!storage_->matched[ordinal]) {
+                storage_->matched[ordinal] = true;
+                storage_->touched.push_back(ordinal);
+            }
+            storage_->relevances[ordinal] += score;
+        }
+
+        // Drops the relevance of the ordinal, which is not matched again
+        void Exclude(uint32_t ordinal) {
+            if (!storage_->excluded[ordinal]) {
+                storage_->excluded[ordinal] = true;
+                storage_->touched.push_back(ordinal);
+            }
+            storage_->matched[ordinal] = false;
+            storage_->relevances[ordinal] = 0.0;
+        }
+
+        bool IsExcluded(uint32_t ordinal) const {
+            return storage_->excluded[ordinal];
+        }
+
+        bool Contains(uint32_t ordinal) const {
+            return storage_->matched[ordinal];
+        }
+
+        // Matched ordinals in ascending order with their relevance
+        std::vector<std::pair<uint32_t, double>> GetMatches() const;
+
+    private:
+        struct Storage {
+            std::vector<double> relevances;
+            std::vector<bool> matched;
+            std::vector<bool> excluded;
+            std::vector<uint32_t> touched;
+            bool in_use = false;
+        };
+
+        Storage own_storage_;
+        Storage* storage_;
+    };
+
+    // Accumulator with the interface of FlatAccumulator that holds only the scored documents
+    class SparseAccumulator {
+    public:
+        void Add(uint32_t ordinal, double score) {
+            relevances_[ordinal] += score;
+        }
+
+        void Exclude(uint32_t ordinal) {
+            relevances_.erase(ordinal);
+            excluded_.insert(ordinal);
+        }
+
+        bool IsExcluded(uint32_t ordinal) const {
+            return excluded_.count(ordinal) > 0;
+        }
+
+        bool Contains(uint32_t ordinal) const {
+            return relevances_.count(ordinal) > 0;
+        }
+
+        std::vector<std::pair<uint32_t, double>> GetMatches() const;
+
+    private:
+        std::unordered_map<uint32_t, double> relevances_;
+        std::unordered_set<uint32_t> excluded_;
+    };
+
+    template<typename Scorer, typename ExecutionPolicy, typename TFilter>
+    std::vector<Document> FindTopDocumentsByQuery(ExecutionPolicy policy, const Query& query, TFilter filter, ScoringControl* control = nullptr) const;
+
+    // Best MAX_RESULT_DOCUMENT_COUNT documents, a sequential partial sort costs O(n log k) and
+    // is cheaper than handing a full sort to another scheduler
+    std::vector<Document> SelectTopDocuments(std::vector<Document> matched_documents) const;
+
+    size_t EstimateQueryCost(const Query& query) const;
+    ExecutionStrategy ChooseExecutionStrategy(const Query& query) const;
+    QueryPlan PlanQuery(const Query& query, bool use_filtered_postings) const;
+    // Sorted ids of the minus terms of a plan, with prefixes expanded
+    std::vector<uint32_t> GetMinusTermIds(const QueryPlan& plan) const;
+    bool ContainsAnyTerm(const DocumentInfo& document_info, const std::vector<uint32_t>& term_ids) const;
+
+    template<typename Scorer, typename Accumulator, typename TFilter>
+    std::vector<Document> ExecuteQueryPlan(const QueryPlan& plan, Accumulator& accumulator, TFilter filter, ScoringControl* control, QueryExplanation* explanation) const;
+    size_t GetParallelWorkerCount() const;
+
+    template<typename Scorer, typename TFilter>
     std::vector<Document> FindAllDocuments(const Query& query, TFilter filter) const;
 
-    template<typename TFilter>
-    std::vector<Document> FindAllDocuments(std::execution::sequenced_policy, const Query& query, TFilter filter) const;
+    template<typename Scorer, typename TFilter>
+    std::vector<Document> FindAllDocuments(std::execution::sequenced_policy, const Query& query, TFilter filter, ScoringControl* control = nullptr, QueryExplanation* explanation = nullptr) const;
+
+    template<typename Scorer, typename TFilter>
+    std::vector<Document> FindAllDocuments(std::execution::parallel_policy, const Query& query, TFilter filter, ScoringControl* control = nullptr) const;
 
-    template<typename TFilter>
-    std::vector<Document> FindAllDocuments(std::execution::parallel_policy, const Query& query, TFilter filter) const;
+    template<typename Scorer, typename TFilter>
+    std::vector<Document> FindAllDocuments(AdaptiveExecutionPolicy, const Query& query, TFilter filter, ScoringControl* control = nullptr) const;
+
+    template<typename Scorer, typename TFilter>
+    std::vector<Document> FindAllDocumentsInRanges(const Query& query, TFilter filter, ScoringControl* control) const;
 
     static bool IsValidWord(const std::string_view word);
 };
@@ -108,105 +688,547 @@ private:
 
 //Def
 
-template<typename ExecutionPolicy, typename TFilter>
+template<typename Scorer, typename ExecutionPolicy, typename TFilter>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy policy, const std::string_view raw_query, TFilter filter) const {
-    Query query = ParseQuery(raw_query);
+    return FindTopDocumentsByQuery<Scorer>(policy, ParseQuery(raw_query), filter);
+}
 
-    std::vector<Document> matched_documents = FindAllDocuments(policy, query, filter);
-    const double EPSILON = 1e-6;
+template<typename Scorer, typename ExecutionPolicy, typename TFilter>
+std::vector<Document> SearchServer::FindTopDocumentsByQuery(ExecutionPolicy policy, const Query& query, TFilter filter, ScoringControl* control) const {
+    return SelectTopDocuments(FindAllDocuments<Scorer>(policy, query, filter, control));
+}
 
-    std::sort(policy, matched_documents.begin(), matched_documents.end(),
-              [&EPSILON](const Document& lhs, const Document& rhs) {
-                  return ((std::abs(lhs.relevance - rhs.relevance) < EPSILON) && lhs.rating > rhs.rating) || (lhs.relevance > rhs.relevance);
-              });
+template<typename Scorer, typename TFilter>
+SearchResult SearchServer::FindTopDocumentsWithin(const std::string_view raw_query, const QueryCancellation& cancellation, TFilter filter) const {
+    return FindTopDocumentsWithin<Scorer>(std::execution::seq, raw_query, cancellation, filter);
+}
 
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
-    return matched_documents;
+template<typename Scorer>
+SearchResult SearchServer::FindTopDocumentsWithin(const std::string_view raw_query, const QueryCancellation& cancellation, const DocumentStatus& status) const {
+    return FindTopDocumentsWithin<Scorer>(std::execution::seq, raw_query, cancellation, StatusFilter{ status });
+}
+
+template<typename Scorer, typename ExecutionPolicy>
+SearchResult SearchServer::FindTopDocumentsWithin(ExecutionPolicy policy, const std::string_view raw_query, const QueryCancellation& cancellation, const DocumentStatus& status) const {
+    return FindTopDocumentsWithin<Scorer>(policy, raw_query, cancellation, StatusFilter{ status });
 }
 
-template<typename ExecutionPolicy>
+template<typename Scorer, typename ExecutionPolicy, typename TFilter>
+SearchResult SearchServer::FindTopDocumentsWithin(ExecutionPolicy policy, const std::string_view raw_query, const QueryCancellation& cancellation, TFilter filter) const {
+    ScoringControl control;
+    control.cancellation = &cancellation;
+    SearchResult result;
+    result.documents = FindTopDocumentsByQuery<Scorer>(policy, ParseQuery(raw_query), filter, &control);
+    result.is_partial = control.interrupted.load(std::memory_order_relaxed);
+    return result;
+}
+
+template<typename Scorer, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy policy, const std::string_view raw_query, const DocumentStatus& status) const {
-    return FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) { return status == document_status; });
+    const Query query = ParseQuery(raw_query);
+    const StatusFilter filter{ status };
+    if (!result_cache_) {
+        return FindTopDocumentsByQuery<Scorer>(policy, query, filter);
+    }
+
+    std::string key = SerializeQuery(query);
+    key += '|';
+    key += std::to_string(static_cast<int>(status));
+    key += '|';
+    key += typeid(Scorer).name();
+    if (auto cached_documents = result_cache_->Get(key, index_generation_)) {
+        return std::move(*cached_documents);
+    }
+    std::vector<Document> documents = FindTopDocumentsByQuery<Scorer>(policy, query, filter);
+    result_cache_->Put(key, index_generation_, documents);
+    return documents;
 }
 
-template<typename TFilter>
+template<typename Scorer, typename TFilter>
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, TFilter filter) const {
-    return FindTopDocuments(std::execution::seq, raw_query, filter);
+    return FindTopDocuments<Scorer>(std::execution::seq, raw_query, filter);
+}
+
+template<typename Scorer>
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, const DocumentStatus& status) const {
+    return FindTopDocuments<Scorer>(std::execution::seq, raw_query, status);
 }
 
-template<typename TFilter>
+template<typename Scorer>
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(const std::vector<std::string>& raw_queries, DocumentStatus status) const {
+    return FindTopDocumentsBatch<Scorer>(std::vector<std::string_view>(raw_queries.begin(), raw_queries.end()), status);
+}
+
+template<typename Scorer>
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(const std::vector<std::string_view>& raw_queries, DocumentStatus status) const {
+    const QueryBatch batch = PrepareQueryBatch(raw_queries, status);
+    const Scorer scorer(GetCorpusStatistics());
+
+    std::vector<double> idfs(batch.plus_terms.size());
+    std::transform(batch.plus_terms.begin(), batch.plus_terms.end(), idfs.begin(), [&scorer](const auto& posting_list) {
+        return scorer.ComputeInverseDocumentFreq(posting_list->document_freq);
+    });
+
+    // Queries each distinct term belongs to, so one pass over its postings serves all of them
+    const size_t query_count = batch.plus_terms_of_query.size();
+    std::vector<std::vector<size_t>> queries_of_plus_term(batch.plus_terms.size());
+    std::vector<std::vector<size_t>> queries_of_minus_term(batch.minus_terms.size());
+    for (size_t query_index = 0; query_index < query_count; ++query_index) {
+        for (const size_t term : batch.plus_terms_of_query[query_index]) {
+            queries_of_plus_term[term].push_back(query_index);
+        }
+        for (const size_t term : batch.minus_terms_of_query[query_index]) {
+            queries_of_minus_term[term].push_back(query_index);
+        }
+    }
+
+    // Every worker owns an ordinal range, walks each distinct posting list once within it and
+    // scatters the scores into the accumulators of all queries with the term
+    const size_t ordinal_count = documents_.size();
+    const size_t range_count = std::max<size_t>(1, std::min(ordinal_count, GetParallelWorkerCount() * 4));
+    std::vector<size_t> ranges(range_count);
+    std::iota(ranges.begin(), ranges.end(), 0);
+    std::vector<std::vector<std::vector<Document>>> range_documents(range_count, std::vector<std::vector<Document>>(query_count));
+    ForEachParallel(ranges.begin(), ranges.end(), [&](size_t range) {
+        const uint32_t range_begin = static_cast<uint32_t>(ordinal_count * range / range_count);
+        const uint32_t range_end = static_cast<uint32_t>(ordinal_count * (range + 1) / range_count);
+        std::vector<std::map<uint32_t, double>> matched_indexes(query_count);
+        for (size_t term = 0; term < batch.plus_terms.size(); ++term) {
+            const std::vector<PostingCache::Posting>& postings = batch.plus_terms[term]->postings;
+            auto posting = std::lower_bound(postings.begin(), postings.end(), range_begin, [](const PostingCache::Posting& lhs, uint32_t ordinal) {
+                return lhs.ordinal < ordinal;
+            });
+            for (; posting != postings.end() && posting->ordinal < range_end; ++posting) {
+                const double score = scorer.ComputeTermScore(posting->term_freq, idfs[term], posting->document_length);
+                for (const size_t query_index : queries_of_plus_term[term]) {
+                    matched_indexes[query_index][posting->ordinal] += score;
+                }
+            }
+        }
+        for (size_t term = 0; term < batch.minus_terms.size(); ++term) {
+            const std::vector<uint32_t>& ordinals = batch.minus_terms[term];
+            for (auto ordinal = std::lower_bound(ordinals.begin(), ordinals.end(), range_begin); ordinal != ordinals.end() && *ordinal < range_end; ++ordinal) {
+                for (const size_t query_index : queries_of_minus_term[term]) {
+                    matched_indexes[query_index].erase(*ordinal);
+                }
+            }
+        }
+
+        for (size_t query_index = 0; query_index < query_count; ++query_index) {
+            std::vector<Document>& matched_documents = range_documents[range][query_index];
+            matched_documents.reserve(matched_indexes[query_index].size());
+            for (const auto& [ordinal, relevance] : matched_indexes[query_index]) {
+                matched_documents.push_back({ external_ids_[ordinal], relevance, documents_[ordinal].rating });
+            }
+        }
+    });
+
+    std::vector<size_t> query_indexes(query_count);
+    std::iota(query_indexes.begin(), query_indexes.end(), 0);
+    std::vector<std::vector<Document>> distinct_results(query_count);
+    ForEachParallel(query_indexes.begin(), query_indexes.end(), [&](size_t query_index) {
+        std::vector<Document> matched_documents;
+        for (std::vector<std::vector<Document>>& documents : range_documents) {
+            matched_documents.insert(matched_documents.end(), documents[query_index].begin(), documents[query_index].end());
+        }
+        distinct_results[query_index] = SelectTopDocuments(std::move(matched_documents));
+    });
+
+    std::vector<std::vector<Document>> results(raw_queries.size());
+    std::transform(batch.distinct_query_of_query.begin(), batch.distinct_query_of_query.end(), results.begin(), [&distinct_results](size_t distinct_query) {
+        return distinct_results[distinct_query];
+    });
+    return results;
+}
+
+template<typename Visitor>
+void SearchServer::VisitPostings(TermIndex::const_iterator term, Visitor visitor) const {
+    if (const std::optional<ColdPostings> cold_postings = ReadColdPostings(term)) {
+        visitor(*cold_postings);
+    } else {
+        visitor(term->second);
+    }
+}
+
+template<typename TPostings>
+std::shared_ptr<const PostingCache::PostingList> SearchServer::BuildFilteredPostings(const TPostings& postings, size_t document_freq, DocumentStatus status) const {
+    auto posting_list = std::make_shared<PostingCache::PostingList>();
+    posting_list->document_freq = document_freq;
+    for (const auto& [ordinal, tf] : postings) {
+        if (!removed_[ordinal] && documents_[ordinal].status == status) {
+            posting_list->postings.push_back({ ordinal, tf, documents_[ordinal].word_count });
+        }
+    }
+    return posting_list;
+}
+
+template<typename Iterator, typename Function>
+void SearchServer::ForEachParallel(Iterator first, Iterator last, Function function) const {
+    if (thread_pool_) {
+        thread_pool_->ForEach(first, last, function);
+    }
+    else {
+        std::for_each(std::execution::par, first, last, function);
+    }
+}
+
+template<typename Scorer, typename TFilter>
+std::future<std::vector<Document>> SearchServer::FindTopDocumentsAsync(std::string raw_query, TFilter filter) const {
+    return GetAsyncExecutor().Submit([this, raw_query = std::move(raw_query), filter]() {
+        return FindTopDocuments<Scorer>(std::execution::seq, raw_query, filter);
+    });
+}
+
+template<typename Scorer>
+std::future<std::vector<Document>> SearchServer::FindTopDocumentsAsync(std::string raw_query, DocumentStatus status) const {
+    return GetAsyncExecutor().Submit([this, raw_query = std::move(raw_query), status]() {
+        return FindTopDocuments<Scorer>(std::execution::seq, raw_query, status);
+    });
+}
+
+template<typename Scorer>
+std::future<std::vector<std::vector<Document>>> SearchServer::FindTopDocumentsBatchAsync(std::vector<std::string> raw_queries, DocumentStatus status) const {
+    return GetAsyncExecutor().Submit([this, raw_queries = std::move(raw_queries), status]() {
+        return FindTopDocumentsBatch<Scorer>(raw_queries, status);
+    });
+}
+
+template<typename Scorer, typename TFilter>
 std::vector<Document> SearchServer::FindAllDocuments(const Query& query, TFilter filter) const {
-    return FindAllDocuments(std::execution::seq, query, filter);
+    return FindAllDocuments<Scorer>(std::execution::seq, query, filter);
+}
+
+template<typename Scorer, typename TFilter>
+std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy, const Query& query, TFilter filter, ScoringControl* control, QueryExplanation* explanation) const {
+    const QueryPlan plan = PlanQuery(query, std::is_same_v<TFilter, StatusFilter> && posting_cache_);
+    if (plan.accumulator == AccumulatorType::SPARSE) {
+        SparseAccumulator accumulator;
+        return ExecuteQueryPlan<Scorer>(plan, accumulator, filter, control, explanation);
+    }
+    FlatAccumulator accumulator(documents_.size());
+    return ExecuteQueryPlan<Scorer>(plan, accumulator, filter, control, explanation);
 }
 
-template<typename TFilter>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy, const Query& query, TFilter filter) const {
-    std::map<int, double> matched_index;
+template<typename Scorer, typename Accumulator, typename TFilter>
+std::vector<Document> SearchServer::ExecuteQueryPlan(const QueryPlan& plan, Accumulator& accumulator, TFilter filter, ScoringControl* control, QueryExplanation* explanation) const {
+    using Clock = std::chrono::steady_clock;
+    const Scorer scorer(GetCorpusStatistics());
+    const bool probe = plan.minus_word_strategy == MinusWordStrategy::PROBE_FORWARD_INDEX;
+    const std::vector<uint32_t> probed_term_ids = probe ? GetMinusTermIds(plan) : std::vector<uint32_t>();
+    if (explanation) {
+        explanation->plan = plan;
+        explanation->stages.assign(plan.terms.size(), {});
+    }
 
-    std::for_each(std::execution::seq, query.plus_words.begin(), query.plus_words.end(), [&](const std::string_view plus_word){
-        const auto& matched_word = index_.find(std::string(plus_word));
-        if (matched_word != index_.end()) {
-            const double idf = ComputeWordInverseDocumentFreq(std::string(plus_word));
-            for (const auto& [id, tf] : index_.at(std::string(plus_word))) {
-                const DocumentInfo& document_info = documents_info_.at(id);
-                if (filter(id, document_info.status, document_info.rating)) {
-                    matched_index[id] += tf * idf;
+    // Checked before the first posting of a term and then every CANCELLATION_CHECK_INTERVAL postings
+    const auto should_stop = [control](size_t scored_postings) {
+        return control && scored_postings % CANCELLATION_CHECK_INTERVAL == 0 && control->ShouldStop();
+    };
+    // Excluded documents are pruned, and with probing a document is checked for minus words when first scored
+    const auto is_excluded = [&](uint32_t ordinal) {
+        if (accumulator.IsExcluded(ordinal)) {
+            return true;
+        }
+        if (probe && !accumulator.Contains(ordinal) && ContainsAnyTerm(documents_[ordinal], probed_term_ids)) {
+            accumulator.Exclude(ordinal);
+            return true;
+        }
+        return false;
+    };
+    const auto add_relevance = [&](const auto& postings, size_t document_freq, QueryExplanation::Stage& stage) {
+        const double idf = scorer.ComputeInverseDocumentFreq(document_freq);
+        for (const auto& [ordinal, tf] : postings) {
+            if (should_stop(stage.actual_postings++)) {
+                return;
+            }
+            // Postings of removed documents stay in the index until Compact
+            if (removed_[ordinal]) {
+                continue;
+            }
+            if (is_excluded(ordinal)) {
+                ++stage.pruned_postings;
+                continue;
+            }
+            const DocumentInfo& document_info = documents_[ordinal];
+            if (filter(external_ids_[ordinal], document_info.status, document_info.rating)) {
+                accumulator.Add(ordinal, scorer.ComputeTermScore(tf, idf, document_info.word_count));
+            }
+        }
+    };
+    const auto add_cached_relevance = [&](const PostingCache::PostingList& posting_list, QueryExplanation::Stage& stage) {
+        const double idf = scorer.ComputeInverseDocumentFreq(posting_list.document_freq);
+        stage.pruned_postings += posting_list.document_freq - posting_list.postings.size();
+        for (const PostingCache::Posting& posting : posting_list.postings) {
+            if (should_stop(stage.actual_postings++)) {
+                return;
+            }
+            if (is_excluded(posting.ordinal)) {
+                ++stage.pruned_postings;
+                continue;
+            }
+            accumulator.Add(posting.ordinal, scorer.ComputeTermScore(posting.term_freq, idf, posting.document_length));
+        }
+    };
+    const auto exclude = [&](const auto& postings, QueryExplanation::Stage& stage) {
+        for (const auto& [ordinal, tf] : postings) {
+            accumulator.Exclude(ordinal);
+            ++stage.actual_postings;
+        }
+    };
+
+    for (size_t position = 0; position < plan.terms.size(); ++position) {
+        const QueryPlan::Term& term = plan.terms[position];
+        const Clock::time_point start = explanation ? Clock::now() : Clock::time_point();
+        QueryExplanation::Stage stage;
+        stage.estimated_postings = term.estimated_postings;
+        if (term.is_minus) {
+            if (!probe) {
+                if (term.is_prefix) {
+                    exclude(MergePrefixPostings(term.word), stage);
+                } else if (const auto matched_word = index_.find(std::string_view(term.word)); matched_word != index_.end()) {
+                    VisitPostings(matched_word, [&](const auto& postings) { exclude(postings, stage); });
+                }
+            }
+        } else if (term.is_prefix) {
+            const Postings postings = MergePrefixPostings(term.word);
+            if (!postings.empty()) {
+                add_relevance(postings, postings.size(), stage);
+            }
+        } else if (plan.pruning == PruningStrategy::FILTERED_POSTINGS) {
+            if constexpr (std::is_same_v<TFilter, StatusFilter>) {
+                if (const auto posting_list = GetFilteredPostings(term.word, filter.status)) {
+                    add_cached_relevance(*posting_list, stage);
+                }
+            }
+        } else if (const auto matched_word = index_.find(std::string_view(term.word)); matched_word != index_.end() && GetDocumentFreq(matched_word) > 0) {
+            VisitPostings(matched_word, [&](const auto& postings) { add_relevance(postings, GetDocumentFreq(matched_word), stage); });
+        }
+        if (explanation) {
+            stage.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+            explanation->stages[position] = stage;
+        }
+    }
+
+    const std::vector<std::pair<uint32_t, double>> matches = accumulator.GetMatches();
+    std::vector<Document> matched_documents;
+    matched_documents.reserve(matches.size());
+    for (const auto& [ordinal, relevance] : matches) {
+        matched_documents.push_back({ external_ids_[ordinal], relevance, documents_[ordinal].rating });
+    }
+    return matched_documents;
+}
+
+template<typename Scorer>
+SearchServer::QueryExplanation SearchServer::Explain(const std::string_view raw_query, DocumentStatus status) const {
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    QueryExplanation explanation;
+    const std::vector<Document> matched_documents = FindAllDocuments<Scorer>(std::execution::seq, ParseQuery(raw_query), StatusFilter{ status }, nullptr, &explanation);
+    explanation.matched_documents = matched_documents.size();
+    explanation.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+    return explanation;
+}
+
+template<typename Scorer, typename TFilter>
+std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_policy, const Query& query, TFilter filter, ScoringControl* control) const {
+    const Scorer scorer(GetCorpusStatistics());
+    ConcurrentMap<uint32_t, double> matched_index(GetParallelWorkerCount() * 4);
+
+    // Checked before the first posting of a term and then every CANCELLATION_CHECK_INTERVAL postings
+    const auto should_stop = [control](size_t scored_postings) {
+        return control && scored_postings % CANCELLATION_CHECK_INTERVAL == 0 && control->ShouldStop();
+    };
+    const auto add_relevance = [&](const auto& postings, size_t document_freq) {
+        const double idf = scorer.ComputeInverseDocumentFreq(document_freq);
+        size_t scored_postings = 0;
+        for (const auto& [ordinal, tf] : postings) {
+            if (should_stop(scored_postings++)) {
+                return;
+            }
+            // Postings of removed documents stay in the index until Compact
+            if (removed_[ordinal]) {
+                continue;
+            }
+            const DocumentInfo& document_info = documents_[ordinal];
+            if (filter(external_ids_[ordinal], document_info.status, document_info.rating)) {
+                matched_index.Add(ordinal, scorer.ComputeTermScore(tf, idf, document_info.word_count));
+            }
+        }
+    };
+    const auto add_cached_relevance = [&](const PostingCache::PostingList& posting_list) {
+        const double idf = scorer.ComputeInverseDocumentFreq(posting_list.document_freq);
+        size_t scored_postings = 0;
+        for (const PostingCache::Posting& posting : posting_list.postings) {
+            if (should_stop(scored_postings++)) {
+                return;
+            }
+            matched_index.Add(posting.ordinal, scorer.ComputeTermScore(posting.term_freq, idf, posting.document_length));
+        }
+    };
+    const auto exclude = [&](const auto& postings) {
+        for (const auto& [ordinal, tf] : postings) {
+            matched_index.erase(ordinal);
+        }
+    };
+
+    ForEachParallel(query.plus_words.begin(), query.plus_words.end(), [&](const std::string_view plus_word){
+        if constexpr (std::is_same_v<TFilter, StatusFilter>) {
+            if (posting_cache_) {
+                if (const auto posting_list = GetFilteredPostings(plus_word, filter.status)) {
+                    add_cached_relevance(*posting_list);
                 }
+                return;
             }
         }
+        const auto& matched_word = index_.find(plus_word);
+        if (matched_word != index_.end() && GetDocumentFreq(matched_word) > 0) {
+            VisitPostings(matched_word, [&](const auto& postings) { add_relevance(postings, GetDocumentFreq(matched_word)); });
+        }
     });
 
-    std::for_each(std::execution::seq, query.minus_words.begin(), query.minus_words.end(), [&](const std::string_view minus_word){
-        const auto& matched_word = index_.find(std::string(minus_word));
+    ForEachParallel(query.plus_prefixes.begin(), query.plus_prefixes.end(), [&](const std::string_view plus_prefix){
+        const Postings postings = MergePrefixPostings(plus_prefix);
+        if (!postings.empty()) {
+            add_relevance(postings, postings.size());
+        }
+    });
+
+    ForEachParallel(query.minus_words.begin(), query.minus_words.end(), [&](const std::string_view minus_word){
+        const auto& matched_word = index_.find(minus_word);
         if (matched_word != index_.end()) {
-            for (const auto& [id, tf] : matched_word->second) {
-                matched_index.erase(id);
-            }
+            VisitPostings(matched_word, exclude);
         }
     });
 
+    ForEachParallel(query.minus_prefixes.begin(), query.minus_prefixes.end(), [&](const std::string_view minus_prefix){
+        exclude(MergePrefixPostings(minus_prefix));
+    });
+
     std::vector<Document> matched_documents;
     matched_documents.reserve(matched_index.size());
-    for (const auto& [id, relevance] : matched_index) {
-        const DocumentInfo& document_info = documents_info_.at(id);
-        matched_documents.push_back({ id, relevance, document_info.rating });
+    for (const auto& [ordinal, relevance] : matched_index.Extract()) {
+        matched_documents.push_back({ external_ids_[ordinal], relevance, documents_[ordinal].rating });
     }
     return matched_documents;
 }
 
-template<typename TFilter>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_policy, const Query& query, TFilter filter) const {
-    ConcurrentMap<int, double> matched_index(std::thread::hardware_concurrency());
+template<typename Scorer, typename TFilter>
+std::vector<Document> SearchServer::FindAllDocuments(AdaptiveExecutionPolicy, const Query& query, TFilter filter, ScoringControl* control) const {
+    switch (ChooseExecutionStrategy(query)) {
+    case ExecutionStrategy::SEQUENTIAL:
+        return FindAllDocuments<Scorer>(std::execution::seq, query, filter, control);
+    case ExecutionStrategy::PER_TERM_PARALLEL:
+        return FindAllDocuments<Scorer>(std::execution::par, query, filter, control);
+    default:
+        return FindAllDocumentsInRanges<Scorer>(query, filter, control);
+    }
+}
+
+template<typename Scorer, typename TFilter>
+std::vector<Document> SearchServer::FindAllDocumentsInRanges(const Query& query, TFilter filter, ScoringControl* control) const {
+    const Scorer scorer(GetCorpusStatistics());
+    if (documents_.empty()) {
+        return {};
+    }
 
-    std::for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), [&](const std::string_view plus_word){
-        const auto& matched_word = index_.find(std::string(plus_word));
+    // Terms are resolved once, then every worker walks only its own ordinal range of each posting list
+    std::vector<Postings> prefix_postings;
+    prefix_postings.reserve(query.plus_prefixes.size() + query.minus_prefixes.size());
+    // Cold terms are read in place from the cold file
+    std::vector<std::pair<const Postings*, double>> plus_postings;
+    std::vector<std::pair<ColdPostings, double>> plus_cold_postings;
+    for (const std::string_view plus_word : query.plus_words) {
+        const auto matched_word = index_.find(plus_word);
+        if (matched_word != index_.end() && GetDocumentFreq(matched_word) > 0) {
+            const double idf = scorer.ComputeInverseDocumentFreq(GetDocumentFreq(matched_word));
+            if (const std::optional<ColdPostings> cold_postings = ReadColdPostings(matched_word)) {
+                plus_cold_postings.emplace_back(*cold_postings, idf);
+            } else {
+                plus_postings.emplace_back(&matched_word->second, idf);
+            }
+        }
+    }
+    for (const std::string_view plus_prefix : query.plus_prefixes) {
+        prefix_postings.push_back(MergePrefixPostings(plus_prefix));
+        if (!prefix_postings.back().empty()) {
+            plus_postings.emplace_back(&prefix_postings.back(), scorer.ComputeInverseDocumentFreq(prefix_postings.back().size()));
+        }
+    }
+    std::vector<const Postings*> minus_postings;
+    std::vector<ColdPostings> minus_cold_postings;
+    for (const std::string_view minus_word : query.minus_words) {
+        const auto matched_word = index_.find(minus_word);
         if (matched_word != index_.end()) {
-            const double idf = ComputeWordInverseDocumentFreq(std::string(plus_word));
-            for (const auto& [id, tf] : index_.at(std::string(plus_word))) {
-                const DocumentInfo& document_info = documents_info_.at(id);
-                if (filter(id, document_info.status, document_info.rating)) {
-                    matched_index[id].ref_to_value += tf * idf;
-                }
+            if (const std::optional<ColdPostings> cold_postings = ReadColdPostings(matched_word)) {
+                minus_cold_postings.push_back(*cold_postings);
+            } else {
+                minus_postings.push_back(&matched_word->second);
             }
         }
-    });
+    }
+    for (const std::string_view minus_prefix : query.minus_prefixes) {
+        prefix_postings.push_back(MergePrefixPostings(minus_prefix));
+        minus_postings.push_back(&prefix_postings.back());
+    }
 
-    std::for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(), [&](const std::string_view minus_word){
-        const auto& matched_word = index_.find(std::string(minus_word));
-        if (matched_word != index_.end()) {
-            for (const auto& [id, tf] : matched_word->second) {
-                matched_index.erase(id);
+    const size_t ordinal_count = documents_.size();
+    const size_t range_count = std::min(ordinal_count, GetParallelWorkerCount() * 4);
+    std::vector<size_t> ranges(range_count);
+    std::iota(ranges.begin(), ranges.end(), 0);
+    std::vector<std::vector<Document>> range_documents(range_count);
+
+    ForEachParallel(ranges.begin(), ranges.end(), [&](size_t range) {
+        const uint32_t range_begin = static_cast<uint32_t>(ordinal_count * range / range_count);
+        const uint32_t range_end = static_cast<uint32_t>(ordinal_count * (range + 1) / range_count);
+        std::map<uint32_t, double> matched_index;
+        const auto add_range_relevance = [&](const auto& postings, double idf) {
+            size_t scored_postings = 0;
+            for (auto it = LowerBound(postings, range_begin); it != postings.end(); ++it) {
+                const auto& [ordinal, tf] = *it;
+                if (ordinal >= range_end || (control && scored_postings++ % CANCELLATION_CHECK_INTERVAL == 0 && control->ShouldStop())) {
+                    break;
+                }
+                if (removed_[ordinal]) {
+                    continue;
+                }
+                const DocumentInfo& document_info = documents_[ordinal];
+                if (filter(external_ids_[ordinal], document_info.status, document_info.rating)) {
+                    matched_index[ordinal] += scorer.ComputeTermScore(tf, idf, document_info.word_count);
+                }
             }
+        };
+        const auto exclude_range = [&](const auto& postings) {
+            for (auto it = LowerBound(postings, range_begin); it != postings.end(); ++it) {
+                const auto& [ordinal, tf] = *it;
+                if (ordinal >= range_end) {
+                    break;
+                }
+                matched_index.erase(ordinal);
+            }
+        };
+        for (const auto& [postings, idf] : plus_postings) {
+            add_range_relevance(*postings, idf);
+        }
+        for (const auto& [postings, idf] : plus_cold_postings) {
+            add_range_relevance(postings, idf);
+        }
+        for (const Postings* postings : minus_postings) {
+            exclude_range(*postings);
+        }
+        for (const ColdPostings& postings : minus_cold_postings) {
+            exclude_range(postings);
+        }
+
+        std::vector<Document>& matched_documents = range_documents[range];
+        matched_documents.reserve(matched_index.size());
+        for (const auto& [ordinal, relevance] : matched_index) {
+            matched_documents.push_back({ external_ids_[ordinal], relevance, documents_[ordinal].rating });
         }
     });
 
     std::vector<Document> matched_documents;
-    matched_documents.reserve(matched_index.size());
-    for (const auto& [id, relevance] : matched_index.BuildOrdinaryMap()) {
-        const DocumentInfo& document_info = documents_info_.at(id);
-        matched_documents.push_back({ id, relevance, document_info.rating });
+    for (std::vector<Document>& documents : range_documents) {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
     }
     return matched_documents;
 }
@@ -222,4 +1244,5 @@ SearchServer::SearchServer(const T& stop_words_container) {
             stop_words_.insert(std::string(stop_word));
         }
     }
+    stop_words_memory_ = ComputeStopWordsMemory();
 }
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "thread_pool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+namespace {
+
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker_index = 0;
+
+}
+
+ThreadPool::ThreadPool(size_t worker_count, bool pin_to_cpus) {
+    worker_count = std::max<size_t>(1, worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    const unsigned cpu_count = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < worker_count; ++i) {
+        threads_.emplace_back(&ThreadPool::RunWorker, this, i);
+#ifdef __linux__
+        if (pin_to_cpus) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % cpu_count, &cpus);
+            pthread_setaffinity_np(threads_.back().native_handle(), sizeof(cpus), &cpus);
+        }
+#else
+        (void)pin_to_cpus;
+        (void)cpu_count;
+#endif
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_up_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+size_t ThreadPool::GetWorkerCount() const {
+    return workers_.size();
+}
+
+void ThreadPool::Push(std::function<void()> task) {
+    size_t worker_index = GetCurrentWorkerIndex();
+    if (worker_index == workers_.size()) {
+        worker_index = next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(workers_[worker_index]->mutex);
+        workers_[worker_index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        pending_tasks_.fetch_add(1, std::memory_order_release);
+    }
+    wake_up_.notify_one();
+}
+
+bool ThreadPool::RunPendingTask() {
+    const size_t own_index = GetCurrentWorkerIndex();
+    std::function<void()> task;
+    if (own_index < workers_.size()) {
+        Worker& own = *workers_[own_index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+    for (size_t offset = 1; !task && offset <= workers_.size(); ++offset) {
+        Worker& victim = *workers_[(own_index + offset) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    pending_tasks_.fetch_sub(1, std::memory_order_relaxed);
+    task();
+    return true;
+}
+
+void ThreadPool::RunWorker(size_t worker_index) {
+    current_pool = this;
+    current_worker_index = worker_index;
+    while (true) {
+        if (RunPendingTask()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_up_.wait(lock, [this]() {
+            return stopping_ || pending_tasks_.load(std::memory_order_acquire) > 0;
+        });
+        if (stopping_ && pending_tasks_.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
+
+size_t ThreadPool::GetCurrentWorkerIndex() const {
+    return current_pool == this ? current_worker_index : workers_.size();
+}
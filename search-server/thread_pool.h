@@ -0,0 +1,127 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a deque: it pushes and pops its own tasks
+// at the back and steals from the front of the others' deques when idle. Threads that
+// wait for pool work (ForEach, Wait) run pending tasks meanwhile, so nested parallel
+// loops neither deadlock nor start extra threads.
+class ThreadPool {
+public:
+    // With pin_to_cpus set, worker i is bound to CPU i modulo the number of CPUs (Linux only)
+    explicit ThreadPool(size_t worker_count = std::thread::hardware_concurrency(), bool pin_to_cpus = false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template<typename Task>
+    auto Submit(Task task) -> std::future<std::invoke_result_t<Task>>;
+
+    // Calls function for every element of the random access range [first, last) and returns once all calls are done
+    template<typename Iterator, typename Function>
+    void ForEach(Iterator first, Iterator last, Function function);
+
+    // Runs pool tasks until future is ready, then returns its value
+    template<typename T>
+    T Wait(std::future<T>& future);
+
+    size_t GetWorkerCount() const;
+
+private:
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> pending_tasks_{ 0 };
+    std::atomic<size_t> next_worker_{ 0 };
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+    bool stopping_ = false;
+
+    void Push(std::function<void()> task);
+    // Runs one pending task, preferring the calling worker's own deque; false if none was found
+    bool RunPendingTask();
+    void RunWorker(size_t worker_index);
+    // Index of the calling thread among this pool's workers, or workers_.size() for outside threads
+    size_t GetCurrentWorkerIndex() const;
+};
+
+
+//Def
+
+template<typename Task>
+auto ThreadPool::Submit(Task task) -> std::future<std::invoke_result_t<Task>> {
+    using Result = std::invoke_result_t<Task>;
+    auto packaged_task = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+    std::future<Result> future = packaged_task->get_future();
+    Push([packaged_task]() { (*packaged_task)(); });
+    return future;
+}
+
+template<typename Iterator, typename Function>
+void ThreadPool::ForEach(Iterator first, Iterator last, Function function) {
+    using Difference = typename std::iterator_traits<Iterator>::difference_type;
+    const Difference size = std::distance(first, last);
+    if (size <= 0) {
+        return;
+    }
+    // A few chunks per worker leave room for stealing when chunks are uneven
+    const Difference chunk_count = std::min(size, static_cast<Difference>(workers_.size() * 4));
+    const Difference chunk_size = (size + chunk_count - 1) / chunk_count;
+
+    std::atomic<Difference> remaining_chunks{ 0 };
+    std::exception_ptr exception;
+    std::mutex exception_mutex;
+    const auto run_chunk = [&](Iterator chunk_first, Iterator chunk_last) {
+        try {
+            std::for_each(chunk_first, chunk_last, function);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(exception_mutex);
+            exception = std::current_exception();
+        }
+        remaining_chunks.fetch_sub(1, std::memory_order_release);
+    };
+
+    for (Difference offset = chunk_size; offset < size; offset += chunk_size) {
+        remaining_chunks.fetch_add(1, std::memory_order_relaxed);
+        const Iterator chunk_first = std::next(first, offset);
+        const Iterator chunk_last = std::next(first, std::min(size, offset + chunk_size));
+        Push([&run_chunk, chunk_first, chunk_last]() { run_chunk(chunk_first, chunk_last); });
+    }
+    remaining_chunks.fetch_add(1, std::memory_order_relaxed);
+    run_chunk(first, std::next(first, std::min(size, chunk_size)));
+
+    while (remaining_chunks.load(std::memory_order_acquire) > 0) {
+        if (!RunPendingTask()) {
+            std::this_thread::yield();
+        }
+    }
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+template<typename T>
+T ThreadPool::Wait(std::future<T>& future) {
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        if (!RunPendingTask()) {
+            std::this_thread::yield();
+        }
+    }
+    return future.get();
+}
@@ -1,13 +1,35 @@
 #include "catch.hpp"
 
+#include <fstream>
+
 #include "../search-server/search_server.h"
 #include "../search-server/search_server.cpp"
 #include "../search-server/document.h"
 #include "../search-server/document.cpp"
 #include "../search-server/string_processing.h"
 #include "../search-server/string_processing.cpp"
+#include "../search-server/deletion_index.h"
+#include "../search-server/deletion_index.cpp"
+#include "../search-server/query_cache.h"
+#include "../search-server/query_cache.cpp"
+#include "../search-server/posting_cache.h"
+#include "../search-server/posting_cache.cpp"
+#include "../search-server/concurrent_map.h"
+#include "../search-server/index_arena.h"
+#include "../search-server/index_arena.cpp"
+#include "../search-server/cold_postings.h"
+#include "../search-server/cold_postings.cpp"
+#include "../search-server/thread_pool.h"
+#include "../search-server/thread_pool.cpp"
+#include "../search-server/query_scheduler.h"
+#include "../search-server/query_scheduler.cpp"
+#include "../search-server/process_queries.h"
+#include "../search-server/process_queries.cpp"
+#include "../search-server/remove_duplicates.h"
+#include "../search-server/remove_duplicates.cpp"
 
 using namespace std::literals::string_literals;
+using namespace std::literals::string_view_literals;
 
 TEST_CASE("String processing", "[string processing]") {
     SECTION("Split words in string") {
@@ -37,6 +59,44 @@ TEST_CASE("String processing", "[string processing]") {
     }
 }
 
+TEST_CASE("Concurrent map", "[concurrent map]") {
+    SECTION("Concurrent updates") {
+        ConcurrentMap<int, double> map(8);
+        std::vector<std::thread> threads;
+        for (int thread = 0; thread < 4; ++thread) {
+            threads.emplace_back([&map]() {
+                for (int key = 0; key < 1000; ++key) {
+                    map.Add(key, 1.0);
+                    map[key % 10].ref_to_value += 0.5;
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(map.size() == 1000);
+        map.erase(5);
+        map.erase(5000);
+        REQUIRE(map.size() == 999);
+
+        double total = 0.0;
+        map.ForEach([&total](int, double value) { total += value; });
+        REQUIRE(total == 4.0 * 999 + 0.5 * 4 * 900);
+        REQUIRE(map.Extract().size() == 999);
+        REQUIRE(map.size() == 0);
+    }
+
+    SECTION("String keys") {
+        ConcurrentMap<std::string, int> map(4);
+        map["cat"s].ref_to_value = 1;
+        map.Add("dog"s, 2);
+        map.Add("cat"s, 2);
+        int total = 0;
+        map.ForEach([&total](const std::string&, int value) { total += value; });
+        REQUIRE(total == 5);
+    }
+}
+
 TEST_CASE("Search server", "[search server]") {
     SECTION("Exclude stop words from added document content") {
         const int doc_id = 42;
@@ -102,6 +162,20 @@ TEST_CASE("Search server", "[search server]") {
         REQUIRE(result.at(0).relevance - 0.866434 < EPSILON);
     }
 
+    SECTION("BM25 relevancy calculation") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        auto result = search_server.FindTopDocuments<Bm25Scorer>("пушистый ухоженный кот"s);
+        constexpr double EPSILON = 1e-6;
+        REQUIRE(result.size() == 2);
+        REQUIRE(result.at(0).id == 1);
+        REQUIRE(std::abs(result.at(0).relevance - 1.135399) < EPSILON);
+        auto par_result = search_server.FindTopDocuments<Bm25Scorer>(std::execution::par, "пушистый ухоженный кот"s);
+        REQUIRE(std::abs(par_result.at(0).relevance - result.at(0).relevance) < EPSILON);
+        REQUIRE(search_server.FindTopDocuments<Bm25Scorer>("пушистый"s, DocumentStatus::BANNED).empty());
+    }
+
     SECTION("Rating calculation") {
         SearchServer search_server("и в на"s);
         search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
@@ -128,6 +202,670 @@ TEST_CASE("Search server", "[search server]") {
         REQUIRE(result.at(1).id == 2);
     }
 
+    SECTION("Prefix query words") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый котёнок пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+
+        auto result = search_server.FindTopDocuments("кот*"s);
+        REQUIRE(result.size() == 2);
+        REQUIRE(search_server.FindTopDocuments(std::execution::par, "кот*"s).size() == 2);
+        REQUIRE(search_server.FindTopDocuments("кот* -пушист*"s).size() == 1);
+
+        auto [matched_words, status] = search_server.MatchDocument("кот*"s, 1);
+        REQUIRE(matched_words == std::vector<std::string_view>{ "котёнок"sv });
+        auto [par_matched_words, par_status] = search_server.MatchDocument(std::execution::par, "кот*"s, 1);
+        REQUIRE(par_matched_words == matched_words);
+
+        REQUIRE_THROWS_AS(search_server.FindTopDocuments("*"s), std::invalid_argument);
+    }
+
+    SECTION("Fuzzy query words") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        REQUIRE(search_server.FindTopDocuments("пушстый"s).empty());
+
+        search_server.EnableFuzzySearch();
+        auto result = search_server.FindTopDocuments("пушстый"s);
+        REQUIRE(result.size() == 1);
+        REQUIRE(result.at(0).id == 1);
+        REQUIRE(search_server.FindTopDocuments("хвсот"s).size() == 1);
+
+        search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+        REQUIRE(search_server.FindTopDocuments("ухоженый"s).at(0).id == 2);
+
+        search_server.RemoveDocument(2);
+        REQUIRE(search_server.FindTopDocuments("ухоженый"s).empty());
+    }
+
+    SECTION("Result cache") {
+        SearchServer search_server("и в на"s);
+        search_server.EnableResultCache(100);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+
+        const auto result = search_server.FindTopDocuments("пушистый кот"s);
+        REQUIRE(search_server.FindTopDocuments("кот пушистый кот"s) == result);
+        REQUIRE(search_server.GetResultCacheStats().hits == 1);
+        REQUIRE(search_server.FindTopDocuments("кот пушистый"s, DocumentStatus::BANNED).empty());
+        REQUIRE(search_server.GetResultCacheStats().misses == 2);
+
+        search_server.RemoveDocument(1);
+        const auto updated_result = search_server.FindTopDocuments("пушистый кот"s);
+        REQUIRE(updated_result.size() == 1);
+        REQUIRE(updated_result.at(0).id == 0);
+    }
+
+    SECTION("Posting cache") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        search_server.AddDocument(2, "пушистый кот на ковре"s, DocumentStatus::BANNED, { 1 });
+        const auto expected = search_server.FindTopDocuments("пушистый кот"s);
+
+        search_server.EnablePostingCache(100);
+        REQUIRE(search_server.FindTopDocuments("пушистый кот"s) == expected);
+        REQUIRE(search_server.FindTopDocuments(std::execution::par, "белый кот"s).size() == 2);
+        REQUIRE(search_server.FindTopDocuments("пушистый кот"s) == expected);
+        const auto stats = search_server.GetPostingCacheStats();
+        REQUIRE(stats.hits == 3);
+        REQUIRE(stats.misses == 3);
+
+        search_server.RemoveDocument(1);
+        REQUIRE(search_server.FindTopDocuments("пушистый кот"s).size() == 1);
+    }
+
+    SECTION("Batch of queries") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+        search_server.AddDocument(3, "ухоженный скворец евгений"s, DocumentStatus::BANNED, { 9 });
+        const std::vector<std::string> queries = { "пушистый кот"s, "кот -хвост"s, "ухоженный пёс"s, "пуш* -белый"s, "кот пушистый"s, "слон"s, "пушистый  кот пушистый"s, "кот -хвост"s };
+
+        const auto results = search_server.FindTopDocumentsBatch(queries);
+        REQUIRE(results.size() == queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            REQUIRE(results[i] == search_server.FindTopDocuments(queries[i]));
+        }
+        const auto banned_results = search_server.FindTopDocumentsBatch<Bm25Scorer>(queries, DocumentStatus::BANNED);
+        REQUIRE(banned_results.at(2) == search_server.FindTopDocuments<Bm25Scorer>(queries[2], DocumentStatus::BANNED));
+    }
+
+    SECTION("Joined processing of queries") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+        const std::vector<std::string> queries = { "пушистый кот"s, "слон"s, "ухоженный пёс"s, "белый"s, "кот -хвост"s };
+
+        std::vector<Document> expected;
+        for (const std::string& query : queries) {
+            for (const Document& document : search_server.FindTopDocuments(query)) {
+                expected.push_back(document);
+            }
+        }
+        REQUIRE(ProcessQueriesJoined(search_server, queries) == expected);
+
+        std::vector<Document> streamed;
+        ProcessQueriesJoined(search_server, queries, [&streamed](Document&& document) { streamed.push_back(document); }, 2);
+        REQUIRE(streamed == expected);
+    }
+
+    SECTION("Parallel execution on thread pool") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+        const std::vector<std::string> queries = { "пушистый кот"s, "ухоженный пёс"s, "белый -хвост"s };
+        const auto expected = ProcessQueries(search_server, queries);
+        const auto expected_joined = ProcessQueriesJoined(search_server, queries);
+
+        search_server.SetThreadPool(std::make_shared<ThreadPool>(3));
+        REQUIRE(ProcessQueries(search_server, queries) == expected);
+        std::vector<Document> joined;
+        ProcessQueriesJoined(search_server, queries, [&joined](Document&& document) { joined.push_back(document); }, 1);
+        REQUIRE(joined == expected_joined);
+        REQUIRE(search_server.FindTopDocuments(std::execution::par, "пушистый кот"s).size() == 2);
+
+        search_server.RemoveDocument(std::execution::par, 1);
+        REQUIRE(search_server.FindTopDocuments(std::execution::par, "пушистый кот"s).size() == 1);
+    }
+
+    SECTION("Asynchronous queries") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::BANNED, { 5, -12, 2, 1 });
+        REQUIRE_THROWS_AS(search_server.FindTopDocumentsAsync("кот"s), std::logic_error);
+
+        search_server.SetThreadPool(std::make_shared<ThreadPool>(2));
+        std::vector<std::future<std::vector<Document>>> pending;
+        for (int i = 0; i < 1000; ++i) {
+            pending.push_back(search_server.FindTopDocumentsAsync(i % 2 ? "пушистый кот"s : "белый"s));
+        }
+        const auto odd_expected = search_server.FindTopDocuments("пушистый кот"s);
+        const auto even_expected = search_server.FindTopDocuments("белый"s);
+        bool all_match = true;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            all_match = all_match && pending[i].get() == (i % 2 ? odd_expected : even_expected);
+        }
+        REQUIRE(all_match);
+
+        auto banned = search_server.FindTopDocumentsAsync("пёс"s, DocumentStatus::BANNED);
+        auto even = search_server.FindTopDocumentsAsync("кот"s, [](int document_id, DocumentStatus, int) { return document_id % 2 == 0; });
+        auto batch = search_server.FindTopDocumentsBatchAsync({ "пушистый кот"s, "белый"s });
+        REQUIRE(banned.get().at(0).id == 2);
+        REQUIRE(even.get().size() == 1);
+        REQUIRE(batch.get().size() == 2);
+    }
+
+    SECTION("Cancelled queries") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+
+        const QueryCancellation no_deadline;
+        const SearchResult full_result = search_server.FindTopDocumentsWithin("пушистый кот"s, no_deadline);
+        REQUIRE_FALSE(full_result.is_partial);
+        REQUIRE(full_result.documents == search_server.FindTopDocuments("пушистый кот"s));
+
+        const QueryCancellation expired(QueryCancellation::Clock::now());
+        const SearchResult partial_result = search_server.FindTopDocumentsWithin(std::execution::par, "пушистый кот"s, expired);
+        REQUIRE(partial_result.is_partial);
+        REQUIRE(partial_result.documents.empty());
+
+        QueryCancellation cancelled(std::chrono::hours(1));
+        cancelled.Cancel();
+        REQUIRE(search_server.FindTopDocumentsWithin("кот"s, cancelled, [](int, DocumentStatus, int) { return true; }).is_partial);
+    }
+
+    SECTION("Query admission control") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        search_server.AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+        REQUIRE(search_server.EstimateQueryCost("пушистый кот -пёс"s) == 4);
+
+        QueryScheduler scheduler(search_server, std::make_shared<ThreadPool>(2));
+        scheduler.SetLimits(QueryPriority::BULK, { 1, 1000, 2 });
+        REQUIRE_THROWS_AS(scheduler.Submit(QueryPriority::BULK, "пушистый кот"s), QueryRejected);
+        REQUIRE(scheduler.GetStats(QueryPriority::BULK).throttled == 1);
+
+        std::vector<std::future<std::vector<Document>>> results;
+        for (int i = 0; i < 20; ++i) {
+            results.push_back(scheduler.Submit(i % 2 ? QueryPriority::INTERACTIVE : QueryPriority::BULK, "пушистый"s));
+        }
+        for (auto& result : results) {
+            REQUIRE(result.get().at(0).id == 1);
+        }
+        REQUIRE(scheduler.GetStats(QueryPriority::INTERACTIVE).completed == 10);
+
+        scheduler.SetLimits(QueryPriority::BULK, { 0, 1 });
+        auto queued = scheduler.Submit(QueryPriority::BULK, "кот"s);
+        REQUIRE_THROWS_AS(scheduler.Submit(QueryPriority::BULK, "кот"s), QueryRejected);
+        REQUIRE(scheduler.GetStats(QueryPriority::BULK).shed == 1);
+        scheduler.SetLimits(QueryPriority::BULK, { 1, 1 });
+        REQUIRE(queued.get().size() == 2);
+
+        // Bulk queries are held back while an interactive query is queued
+        scheduler.SetLimits(QueryPriority::INTERACTIVE, { 0, 1 });
+        auto interactive = scheduler.Submit(QueryPriority::INTERACTIVE, "пушистый"s);
+        auto bulk = scheduler.Submit(QueryPriority::BULK, "кот"s);
+        REQUIRE(bulk.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout);
+        scheduler.SetLimits(QueryPriority::INTERACTIVE, { 1, 1 });
+        REQUIRE(interactive.get().at(0).id == 1);
+        REQUIRE(bulk.get().size() == 2);
+        REQUIRE(scheduler.GetStats(QueryPriority::INTERACTIVE).completed == 11);
+        REQUIRE(scheduler.GetStats(QueryPriority::INTERACTIVE).failed == 0);
+    }
+
+    SECTION("Adaptive execution") {
+        SearchServer search_server("и в на"s);
+        search_server.SetThreadPool(std::make_shared<ThreadPool>(2));
+        for (int id = 0; id < 300; ++id) {
+            const std::string text = (id % 3 ? "пушистый кот "s : "белый пёс "s) + (id % 5 ? "хвост"s : "ошейник"s);
+            search_server.AddDocument(id * 7, text, id % 4 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED, { id % 10 });
+        }
+        const std::string query = "пушистый пёс -ошейник"s;
+        const auto expected = search_server.FindTopDocuments(query);
+        REQUIRE(search_server.ChooseExecutionStrategy(query) == SearchServer::ExecutionStrategy::SEQUENTIAL);
+        REQUIRE(search_server.FindTopDocuments(adaptive_execution, query) == expected);
+
+        search_server.SetAdaptiveParallelThreshold(1);
+        REQUIRE(search_server.ChooseExecutionStrategy(query) == SearchServer::ExecutionStrategy::DOCUMENT_RANGE_PARALLEL);
+        REQUIRE(search_server.FindTopDocuments(adaptive_execution, query) == expected);
+        REQUIRE(search_server.FindTopDocuments(adaptive_execution, "пуш*"s, DocumentStatus::BANNED) == search_server.FindTopDocuments("пуш*"s, DocumentStatus::BANNED));
+        REQUIRE(search_server.ChooseExecutionStrategy("пушистый кот пёс хвост"s) == SearchServer::ExecutionStrategy::PER_TERM_PARALLEL);
+        REQUIRE(std::get<0>(search_server.MatchDocument(adaptive_execution, query, 7)).size() == 1);
+
+        search_server.CalibrateAdaptiveExecution();
+        REQUIRE(search_server.GetAdaptiveParallelThreshold() >= 1024);
+    }
+
+    SECTION("Bulk document ingestion") {
+        const std::vector<std::string> texts = { "белый кот и модный ошейник"s, "пушистый кот пушистый хвост"s, "ухоженный пёс выразительные глаза"s, "кот\x12"s };
+        SearchServer expected_server("и в на"s);
+        SearchServer search_server("и в на"s);
+        search_server.SetThreadPool(std::make_shared<ThreadPool>(2));
+        search_server.AddDocument(100, "пушистый пёс"s, DocumentStatus::ACTUAL, { 1 });
+        expected_server.AddDocument(100, "пушистый пёс"s, DocumentStatus::ACTUAL, { 1 });
+        std::vector<DocumentToAdd> documents;
+        for (int id = 0; id < 40; ++id) {
+            documents.push_back({ id, texts[id % 3], id % 2 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED, { id } });
+            expected_server.AddDocument(id, texts[id % 3], id % 2 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED, { id });
+        }
+        documents.push_back({ -1, texts[0], DocumentStatus::ACTUAL, {} });
+        documents.push_back({ 100, texts[0], DocumentStatus::ACTUAL, {} });
+        documents.push_back({ 7, texts[0], DocumentStatus::ACTUAL, {} });
+        documents.push_back({ 50, texts[3], DocumentStatus::ACTUAL, {} });
+
+        const auto errors = search_server.AddDocuments(documents);
+        REQUIRE(errors.size() == documents.size());
+        REQUIRE(std::all_of(errors.begin(), errors.begin() + 40, [](const std::exception_ptr& error) { return !error; }));
+        REQUIRE(std::all_of(errors.begin() + 40, errors.end(), [](const std::exception_ptr& error) { return error != nullptr; }));
+        REQUIRE_THROWS_AS(std::rethrow_exception(errors.back()), std::invalid_argument);
+        REQUIRE(search_server.GetDocumentCount() == 41);
+        REQUIRE(search_server.GetWordFrequencies(1) == expected_server.GetWordFrequencies(1));
+        for (const std::string& query : { "пушистый кот"s, "пёс -хвост"s, "белый ошейник"s }) {
+            REQUIRE(search_server.FindTopDocuments(query) == expected_server.FindTopDocuments(query));
+            REQUIRE(search_server.FindTopDocuments(query, DocumentStatus::BANNED) == expected_server.FindTopDocuments(query, DocumentStatus::BANNED));
+        }
+    }
+
+    SECTION("Batch document removal") {
+        SearchServer search_server("и в на"s);
+        SearchServer expected_server("и в на"s);
+        search_server.SetThreadPool(std::make_shared<ThreadPool>(3));
+        std::vector<int> removed_ids;
+        for (int id = 0; id < 60; ++id) {
+            const std::string text = (id % 3 ? "пушистый кот "s : "белый пёс "s) + (id % 5 ? "хвост"s : "ошейник"s);
+            search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+            if (id % 4) {
+                expected_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+            } else {
+                removed_ids.push_back(id);
+            }
+        }
+        removed_ids.push_back(0);
+        removed_ids.push_back(1000);
+
+        REQUIRE(search_server.RemoveDocuments(removed_ids) == 15);
+        REQUIRE(search_server.GetDocumentCount() == 45);
+        REQUIRE_THROWS_AS(search_server.GetWordFrequencies(0), std::out_of_range);
+        for (const std::string& query : { "пушистый кот"s, "пёс -хвост"s, "ошейник"s }) {
+            REQUIRE(search_server.FindTopDocuments(query) == expected_server.FindTopDocuments(query));
+        }
+        REQUIRE(search_server.RemoveDocuments(removed_ids) == 0);
+    }
+
+    SECTION("Tombstone deletes") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        for (int id = 2; id < 8; ++id) {
+            search_server.AddDocument(id, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, { id });
+        }
+
+        search_server.RemoveDocument(1);
+        REQUIRE(search_server.GetTombstoneCount() == 1);
+        REQUIRE(search_server.GetDocumentCount() == 7);
+        REQUIRE(search_server.FindTopDocuments("пушистый кот"s).size() == 1);
+        REQUIRE(search_server.FindTopDocuments(std::execution::par, "пушистый кот"s).size() == 1);
+        REQUIRE(search_server.EstimateQueryCost("хвост"s) == 0);
+
+        search_server.Compact();
+        REQUIRE(search_server.GetTombstoneCount() == 0);
+        REQUIRE(search_server.EstimateQueryCost("хвост"s) == 0);
+
+        search_server.RemoveDocument(0);
+        search_server.AddDocument(0, "пушистый хвост"s, DocumentStatus::ACTUAL, { 1 });
+        REQUIRE(search_server.FindTopDocuments("белый"s).empty());
+        REQUIRE(search_server.FindTopDocuments("хвост"s).at(0).id == 0);
+
+        REQUIRE(search_server.RemoveDocuments({ 2, 3 }) == 2);
+        REQUIRE(search_server.GetTombstoneCount() == 0);
+        REQUIRE(search_server.FindTopDocuments("пёс"s).size() == 4);
+    }
+
+    SECTION("Live document frequency") {
+        SearchServer search_server("и в на"s);
+        for (int id = 0; id < 10; ++id) {
+            const std::string text = id < 4 ? "пушистый кот пушистый хвост"s : id < 6 ? "белый кит и модный ошейник"s : "ухоженный пёс белый хвост"s;
+            search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+        }
+        search_server.RemoveDocument(4);
+        search_server.RemoveDocument(5);
+        REQUIRE(search_server.GetTombstoneCount() == 2);
+
+        // Removed documents no longer count towards idf, so ranking does not wait for Compact
+        const std::vector<std::string> queries = { "пушистый хвост"s, "белый пёс"s, "бел* кот"s, "хвост -кот"s };
+        std::vector<std::vector<Document>> before;
+        for (const std::string& query : queries) {
+            before.push_back(search_server.FindTopDocuments(query));
+            for (const Document& document : before.back()) {
+                REQUIRE(document.relevance >= 0);
+            }
+        }
+        const auto bm25_before = search_server.FindTopDocuments<Bm25Scorer>("белый хвост"s);
+        const auto par_before = search_server.FindTopDocuments(std::execution::par, "белый"s);
+        const auto batch_before = ProcessQueries(search_server, queries);
+
+        search_server.Compact();
+        REQUIRE(search_server.GetTombstoneCount() == 0);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            REQUIRE(search_server.FindTopDocuments(queries[i]) == before[i]);
+        }
+        REQUIRE(search_server.FindTopDocuments<Bm25Scorer>("белый хвост"s) == bm25_before);
+        REQUIRE(search_server.FindTopDocuments(std::execution::par, "белый"s) == par_before);
+        REQUIRE(ProcessQueries(search_server, queries) == batch_before);
+
+        // A word whose documents are all removed is unknown to fuzzy matching, before Compact as well
+        search_server.AddDocument(10, "белый кит"s, DocumentStatus::ACTUAL, { 1 });
+        search_server.EnableFuzzySearch();
+        REQUIRE(search_server.FindTopDocuments("кит"s).at(0).id == 10);
+        search_server.RemoveDocument(10);
+        const auto result = search_server.FindTopDocuments("кит"s);
+        REQUIRE(result.size() == 4);
+        REQUIRE(search_server.FindTopDocuments("ки*"s).empty());
+    }
+
+    SECTION("Document updates") {
+        SearchServer search_server("и в на"s);
+        SearchServer expected_server("и в на"s);
+        search_server.EnableResultCache(100);
+        search_server.EnableFuzzySearch();
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        expected_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        expected_server.AddDocument(1, "ухоженный кот выразительные глаза"s, DocumentStatus::ACTUAL, { 5 });
+        REQUIRE(search_server.FindTopDocuments("пушистый кот"s).size() == 2);
+
+        search_server.UpdateDocument(1, "ухоженный кот выразительные глаза"s, DocumentStatus::ACTUAL, { 5 });
+        REQUIRE(search_server.GetWordFrequencies(1) == expected_server.GetWordFrequencies(1));
+        REQUIRE(search_server.FindTopDocuments("пушистый кот"s) == expected_server.FindTopDocuments("пушистый кот"s));
+        REQUIRE(search_server.FindTopDocuments("глаза"s) == expected_server.FindTopDocuments("глаза"s));
+        REQUIRE(search_server.EstimateQueryCost("пушистый"s) == 0);
+
+        search_server.UpdateDocumentStatus(0, DocumentStatus::BANNED);
+        REQUIRE(search_server.FindTopDocuments("кот"s).size() == 1);
+        REQUIRE(search_server.FindTopDocuments("кот"s, DocumentStatus::BANNED).at(0).id == 0);
+        search_server.UpdateDocumentRating(1, { 1, 2 });
+        REQUIRE(search_server.FindTopDocuments("кот"s).at(0).rating == 1);
+
+        REQUIRE_THROWS_AS(search_server.UpdateDocumentStatus(5, DocumentStatus::BANNED), std::out_of_range);
+        REQUIRE_THROWS_AS(search_server.UpdateDocument(1, "кот\x12"s, DocumentStatus::ACTUAL, { 1 }), std::invalid_argument);
+        REQUIRE(search_server.FindTopDocuments("глаза"s).size() == 1);
+    }
+
+    SECTION("Forward index") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        search_server.AddDocument(2, "хвост кот пушистый"s, DocumentStatus::ACTUAL, { 1 });
+        search_server.AddDocument(3, "модный ошейник белый кот"s, DocumentStatus::ACTUAL, { 1 });
+
+        const std::map<std::string, double> expected_freqs = { { "кот"s, 0.25 }, { "пушистый"s, 0.5 }, { "хвост"s, 0.25 } };
+        REQUIRE(search_server.GetWordFrequencies(1) == expected_freqs);
+        REQUIRE(search_server.GetDocumentTermIds(1) == search_server.GetDocumentTermIds(2));
+        REQUIRE(std::get<0>(search_server.MatchDocument(std::execution::par, "пуш* кот -белый"s, 1)) == std::vector<std::string_view>{ "кот"sv, "пушистый"sv });
+        REQUIRE(std::get<0>(search_server.MatchDocument(std::execution::par, "пуш* кот -бел*"s, 0)).empty());
+        REQUIRE(std::get<0>(search_server.MatchDocument("хвост ошейник"s, 3)) == std::vector<std::string_view>{ "ошейник"sv });
+
+        for (int version = 0; version < 10; ++version) {
+            search_server.UpdateDocument(3, version % 2 ? "модный ошейник белый кот"s : "белый пёс"s, DocumentStatus::ACTUAL, { 1 });
+        }
+        REQUIRE(search_server.GetWordFrequencies(3) == search_server.GetWordFrequencies(0));
+
+        RemoveDuplicates(search_server);
+        REQUIRE(std::vector<int>(search_server.begin(), search_server.end()) == std::vector<int>{ 0, 1 });
+    }
+
+    SECTION("Index memory arena") {
+        static_assert(!std::is_copy_constructible_v<SearchServer> && !std::is_copy_assignable_v<SearchServer>);
+        static_assert(!std::is_move_constructible_v<SearchServer> && !std::is_move_assignable_v<SearchServer>);
+        SearchServer search_server("и в на"s);
+        REQUIRE(search_server.GetIndexMemoryStats().bytes_used == 0);
+        for (int id = 0; id < 100; ++id) {
+            search_server.AddDocument(id, "пушистый кот номер "s + std::to_string(id), DocumentStatus::ACTUAL, { id });
+        }
+        const IndexArena::Stats filled = search_server.GetIndexMemoryStats();
+        REQUIRE(filled.bytes_used > 100 * sizeof(std::pair<const int, double>));
+        REQUIRE(filled.bytes_reserved >= filled.bytes_used);
+
+        std::vector<int> removed_ids(50);
+        std::iota(removed_ids.begin(), removed_ids.end(), 0);
+        search_server.RemoveDocuments(removed_ids);
+        search_server.Compact();
+        REQUIRE(search_server.GetIndexMemoryStats().bytes_used < filled.bytes_used);
+        REQUIRE(search_server.FindTopDocuments("7"s).empty());
+        REQUIRE(search_server.FindTopDocuments("77"s).at(0).id == 77);
+    }
+
+    SECTION("Dense document ordinals") {
+        SearchServer search_server("и в на"s);
+        const std::vector<int> ids = { 1000000000, 7, 123456 };
+        search_server.AddDocument(ids[0], "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocument(ids[1], "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        search_server.AddDocument(ids[2], "ухоженный пёс выразительные глаза"s, DocumentStatus::BANNED, { 5 });
+        REQUIRE(std::vector<int>(search_server.begin(), search_server.end()) == std::vector<int>{ 7, 123456, 1000000000 });
+        REQUIRE(search_server.FindTopDocuments("кот"s) == search_server.FindTopDocuments(std::execution::par, "кот"s));
+        REQUIRE(search_server.FindTopDocuments("пушистый кот -белый"s).at(0).id == 7);
+        REQUIRE(search_server.FindTopDocuments("глаза"s, DocumentStatus::BANNED).at(0).id == 123456);
+        REQUIRE(search_server.FindTopDocuments("кот"s, [](int document_id, DocumentStatus, int) { return document_id > 100; }).at(0).id == 1000000000);
+
+        // A tombstoned id can be added again before its postings are compacted
+        for (int id = 0; id < 4; ++id) {
+            search_server.AddDocument(id, "ухоженный скворец"s, DocumentStatus::ACTUAL, { id });
+        }
+        search_server.RemoveDocument(ids[1]);
+        search_server.AddDocument(ids[1], "белый хвост"s, DocumentStatus::ACTUAL, { 1 });
+        REQUIRE(search_server.GetTombstoneCount() == 1);
+        REQUIRE(search_server.FindTopDocuments("пушистый"s).empty());
+        REQUIRE(search_server.FindTopDocuments("хвост"s).at(0).id == 7);
+        REQUIRE(std::get<0>(search_server.MatchDocument("пушистый хвост"s, 7)) == std::vector<std::string_view>{ "хвост"sv });
+
+        // Ordinals freed by compaction are reused by later documents
+        search_server.Compact();
+        search_server.AddDocument(42, "пушистый кот"s, DocumentStatus::ACTUAL, { 2 });
+        REQUIRE(search_server.FindTopDocuments("пушистый"s).at(0).id == 42);
+        REQUIRE(search_server.FindTopDocuments(std::execution::par, "кот -модный"s).at(0).id == 42);
+        REQUIRE(ProcessQueries(search_server, { "хвост"s, "ошейник"s }).at(1).at(0).id == 1000000000);
+    }
+
+    SECTION("Memory budget") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        const SearchServer::MemoryStats stats = search_server.GetMemoryStats();
+        REQUIRE(stats.postings == 4 * (sizeof(std::pair<const uint32_t, double>) + 4 * sizeof(void*)));
+        REQUIRE(stats.vocabulary > 0);
+        REQUIRE(stats.forward_index >= 4 * 2 * sizeof(uint32_t));
+        REQUIRE(stats.documents > 0);
+        REQUIRE(stats.stop_words >= 3 * sizeof(std::string));
+        REQUIRE(stats.GetTotal() >= search_server.GetIndexMemoryStats().bytes_reserved);
+
+        search_server.EnableMemoryBudget(stats.GetTotal() + 1);
+        search_server.AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        REQUIRE_THROWS_AS(search_server.AddDocument(2, "ухоженный пёс"s, DocumentStatus::ACTUAL, { 1 }), MemoryBudgetExceeded);
+        const auto errors = search_server.AddDocuments({ { 2, "ухоженный пёс"sv, DocumentStatus::ACTUAL, { 1 } }, { 1, "пёс"sv, DocumentStatus::ACTUAL, { 1 } } });
+        REQUIRE_THROWS_AS(std::rethrow_exception(errors.at(0)), MemoryBudgetExceeded);
+        REQUIRE_THROWS_AS(std::rethrow_exception(errors.at(1)), std::invalid_argument);
+        REQUIRE(search_server.GetDocumentCount() == 2);
+        search_server.UpdateDocument(1, "пушистый хвост"s, DocumentStatus::ACTUAL, { 1 });
+
+        search_server.DisableMemoryBudget();
+        search_server.AddDocument(2, "ухоженный пёс"s, DocumentStatus::ACTUAL, { 1 });
+        REQUIRE(search_server.FindTopDocuments("пёс"s).at(0).id == 2);
+    }
+
+    SECTION("Tiered postings") {
+        SearchServer search_server("и в на"s);
+        SearchServer expected_server("и в на"s);
+        for (SearchServer* server : { &search_server, &expected_server }) {
+            server->AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+            server->AddDocument(1, "пушистый кот пушистый хвост"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+            server->AddDocument(2, "ухоженный пёс выразительные глаза"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+            server->AddDocument(3, "ухоженный скворец евгений"s, DocumentStatus::BANNED, { 9 });
+        }
+        const std::string path = "tiered_postings_test.bin"s;
+        // Room for two postings, the rest of the vocabulary goes to the cold file
+        search_server.EnableTieredPostings(path, 2 * (sizeof(std::pair<const uint32_t, double>) + 4 * sizeof(void*)));
+        SearchServer::TierStats stats = search_server.GetTierStats();
+        REQUIRE(stats.resident_terms + stats.cold_terms == 12);
+        REQUIRE(stats.cold_postings > 0);
+        REQUIRE(std::ifstream(path).good());
+
+        for (const std::string& query : { "пушистый кот -модный"s, "ухоженный пёс"s, "ух* -евгений"s, "ошейник"s }) {
+            REQUIRE(search_server.FindTopDocuments(query) == expected_server.FindTopDocuments(query));
+            REQUIRE(search_server.FindTopDocuments(std::execution::par, query) == expected_server.FindTopDocuments(std::execution::par, query));
+            REQUIRE(search_server.EstimateQueryCost(query) == expected_server.EstimateQueryCost(query));
+        }
+        REQUIRE(search_server.GetTierStats().page_ins > 0);
+
+        // Cold terms are indexed for fuzzy matching like resident ones
+        search_server.EnableFuzzySearch();
+        expected_server.EnableFuzzySearch();
+        REQUIRE(search_server.FindTopDocuments("пушстый"s).size() == 1);
+        REQUIRE(search_server.FindTopDocuments("пушстый"s) == expected_server.FindTopDocuments("пушстый"s));
+
+        // The most read terms become resident once the tiers are rebalanced
+        for (int i = 0; i < 10; ++i) {
+            search_server.FindTopDocuments("ухоженный"s);
+        }
+        search_server.RebalanceTiers();
+        const uint64_t page_ins = search_server.GetTierStats().page_ins;
+        search_server.FindTopDocuments("ухоженный"s);
+        REQUIRE(search_server.GetTierStats().page_ins == page_ins);
+        REQUIRE(search_server.GetTierStats().promotions > 0);
+
+        // Modifications of cold terms promote them
+        search_server.UpdateDocument(3, "ухоженный скворец пётр"s, DocumentStatus::BANNED, { 9 });
+        search_server.RemoveDocument(0);
+        search_server.Compact();
+        expected_server.UpdateDocument(3, "ухоженный скворец пётр"s, DocumentStatus::BANNED, { 9 });
+        expected_server.RemoveDocument(0);
+        expected_server.Compact();
+        for (const std::string& query : { "белый кот"s, "евгений"s, "пётр"s }) {
+            REQUIRE(search_server.FindTopDocuments(query, DocumentStatus::BANNED) == expected_server.FindTopDocuments(query, DocumentStatus::BANNED));
+            REQUIRE(search_server.FindTopDocuments(query) == expected_server.FindTopDocuments(query));
+        }
+
+        search_server.DisableTieredPostings();
+        REQUIRE(search_server.GetTierStats().cold_terms == 0);
+        REQUIRE_FALSE(std::ifstream(path).good());
+        REQUIRE(search_server.FindTopDocuments("ошейник"s).empty());
+        REQUIRE(search_server.FindTopDocuments("хвост"s) == expected_server.FindTopDocuments("хвост"s));
+    }
+
+    SECTION("Index statistics") {
+        SearchServer search_server("и в на"s);
+        search_server.AddDocument(0, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 8, -3 });
+        search_server.AddDocuments({ { 1, "пушистый кот пушистый хвост"sv, DocumentStatus::ACTUAL, { 7, 2, 7 } },
+                                     { 2, "ухоженный пёс выразительные глаза"sv, DocumentStatus::BANNED, { 5 } },
+                                     { 3, "кот пёс"sv, DocumentStatus::ACTUAL, { 1 } } });
+
+        SearchServer::IndexStatistics statistics = search_server.GetIndexStatistics(2);
+        REQUIRE(statistics.vocabulary_size == 10);
+        REQUIRE(statistics.document_count == 4);
+        REQUIRE(statistics.average_document_length == Approx(3.5));
+        REQUIRE(statistics.posting_length_histogram == std::vector<size_t>{ 8, 2 });
+        REQUIRE(statistics.heaviest_terms == std::vector<std::pair<std::string, size_t>>{ { "кот"s, 3 }, { "пёс"s, 2 } });
+        REQUIRE(statistics.documents_by_status == std::map<DocumentStatus, size_t>{ { DocumentStatus::ACTUAL, 3 }, { DocumentStatus::BANNED, 1 } });
+
+        search_server.UpdateDocument(3, "кот скворец"s, DocumentStatus::IRRELEVANT, { 1 });
+        search_server.UpdateDocumentStatus(2, DocumentStatus::ACTUAL);
+        statistics = search_server.GetIndexStatistics(0);
+        REQUIRE(statistics.posting_length_histogram == std::vector<size_t>{ 10, 1 });
+        REQUIRE(statistics.heaviest_terms.empty());
+        REQUIRE(statistics.documents_by_status == std::map<DocumentStatus, size_t>{ { DocumentStatus::ACTUAL, 3 }, { DocumentStatus::IRRELEVANT, 1 } });
+
+        // One tombstone among three live documents is enough for compaction
+        search_server.RemoveDocument(0);
+        statistics = search_server.GetIndexStatistics(1);
+        REQUIRE(statistics.tombstone_count == 0);
+        REQUIRE(statistics.vocabulary_size == 8);
+        REQUIRE(statistics.posting_length_histogram == std::vector<size_t>{ 7, 1 });
+        REQUIRE(statistics.documents_by_status == std::map<DocumentStatus, size_t>{ { DocumentStatus::ACTUAL, 2 }, { DocumentStatus::IRRELEVANT, 1 } });
+        REQUIRE(statistics.heaviest_terms == std::vector<std::pair<std::string, size_t>>{ { "кот"s, 2 } });
+
+        // Before Compact the tombstone is left out of every field alike
+        for (int id = 10; id < 18; ++id) {
+            search_server.AddDocument(id, "кот пёс"s, DocumentStatus::ACTUAL, { 1 });
+        }
+        search_server.RemoveDocument(1);
+        statistics = search_server.GetIndexStatistics(2);
+        REQUIRE(statistics.tombstone_count == 1);
+        REQUIRE(statistics.vocabulary_size == 6);
+        REQUIRE(statistics.posting_length_histogram == std::vector<size_t>{ 4, 0, 0, 2 });
+        REQUIRE(statistics.heaviest_terms == std::vector<std::pair<std::string, size_t>>{ { "пёс"s, 9 }, { "кот"s, 9 } });
+    }
+
+    SECTION("Query planner") {
+        SearchServer search_server("и в на"s);
+        for (int id = 0; id < 100; ++id) {
+            std::string text = "кот"s;
+            text += id % 10 == 3 ? " пёс"s : ""s;
+            text += id % 5 == 0 || id == 13 ? " ошейник"s : ""s;
+            text += id == 23 ? " хвост"s : ""s;
+            text += id == 42 ? " редкий"s : ""s;
+            search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+        }
+        const auto get_ids = [](const std::vector<Document>& documents) {
+            std::vector<int> ids;
+            for (const Document& document : documents) {
+                ids.push_back(document.id);
+            }
+            std::sort(ids.begin(), ids.end());
+            return ids;
+        };
+
+        SearchServer::QueryPlan plan = search_server.PlanQuery("кот редкий"s);
+        REQUIRE(plan.terms.size() == 2);
+        REQUIRE(plan.terms[0].word == "редкий"s);
+        REQUIRE(plan.terms[1].estimated_postings == 100);
+        REQUIRE(plan.accumulator == SearchServer::AccumulatorType::FLAT);
+        REQUIRE(search_server.FindTopDocuments("кот редкий"s).at(0).id == 42);
+
+        // One candidate is cheaper to look up in the forward index than reading the minus postings
+        plan = search_server.PlanQuery("редкий -кот"s);
+        REQUIRE(plan.minus_word_strategy == SearchServer::MinusWordStrategy::PROBE_FORWARD_INDEX);
+        REQUIRE(plan.accumulator == SearchServer::AccumulatorType::SPARSE);
+        REQUIRE(plan.estimated_postings == 1);
+        SearchServer::QueryExplanation explanation = search_server.Explain("редкий -кот"s);
+        REQUIRE(explanation.matched_documents == 0);
+        REQUIRE(explanation.stages.at(0).actual_postings == 1);
+        REQUIRE(explanation.stages.at(0).pruned_postings == 1);
+        REQUIRE(explanation.stages.at(1).actual_postings == 0);
+
+        plan = search_server.PlanQuery("кот -редкий"s);
+        REQUIRE(plan.minus_word_strategy == SearchServer::MinusWordStrategy::EXCLUDE_BEFORE);
+        REQUIRE(plan.terms[0].is_minus);
+        explanation = search_server.Explain("кот -редкий"s);
+        REQUIRE(explanation.matched_documents == 99);
+        REQUIRE(explanation.stages.at(1).estimated_postings == 100);
+        REQUIRE(explanation.stages.at(1).actual_postings == 100);
+        REQUIRE(explanation.stages.at(1).pruned_postings == 1);
+        REQUIRE(explanation.duration >= explanation.stages.at(1).duration);
+
+        plan = search_server.PlanQuery("пёс -ошейник -хвост"s);
+        REQUIRE(plan.minus_word_strategy == SearchServer::MinusWordStrategy::EXCLUDE_AFTER);
+        REQUIRE(plan.terms[0].word == "пёс"s);
+        REQUIRE(get_ids(search_server.FindTopDocuments("пёс -ошейник -хвост"s)) == std::vector<int>{ 53, 63, 73, 83, 93 });
+        explanation = search_server.Explain("пёс -ошейник -хв*"s);
+        REQUIRE(explanation.plan.terms.at(1).is_prefix);
+        REQUIRE(explanation.matched_documents == 8);
+
+        for (const std::string& query : { "кот -ошейник"s, "пёс -редкий -хв*"s, "ош* -пёс"s, "хвост пёс -ошейник"s }) {
+            REQUIRE(get_ids(search_server.FindTopDocuments(query)) == get_ids(search_server.FindTopDocuments(std::execution::par, query)));
+        }
+        search_server.EnablePostingCache(1000);
+        REQUIRE(search_server.PlanQuery("кот -редкий"s).pruning == SearchServer::PruningStrategy::FILTERED_POSTINGS);
+        REQUIRE(search_server.Explain("кот -редкий"s).matched_documents == 99);
+        REQUIRE(search_server.Explain("кот"s, DocumentStatus::BANNED).stages.at(0).actual_postings == 0);
+    }
+
     SECTION("Constructor with stop words string") {
         {
             SearchServer search_server("и в на"s);